@@ -0,0 +1,199 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "analysis.h"
+#include "decode.h"
+#include "chip8.h"
+
+#define ANALYSIS_MAGIC   (0x4e413843)   // "C8AN"
+#define ANALYSIS_VERSION (2)
+
+// Fetch opcode from memory image
+static uint16_t fetch(const uint8_t* mem, uint16_t addr) {
+    return (mem[addr] << 8) + mem[addr + 1];
+}
+
+// True if an instruction at addr fits in memory
+static bool in_range(uint16_t addr) {
+    return addr + 1 < CODE_MAP_SIZE;
+}
+
+// Hash program bytes from the reset vector up (FNV-1a)
+uint32_t rom_hash(const uint8_t* mem) {
+    uint32_t h = 2166136261u;
+    for (uint16_t a = RESET_VECTOR; a < CODE_MAP_SIZE; a++) {
+        h ^= mem[a];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// Address after the instruction skipped from addr, which may be long
+static uint16_t skip_target(const uint8_t* mem, uint16_t addr) {
+    return addr + (in_range(addr) ? op_length(fetch(mem, addr)) : 2);
+}
+
+// Mark address as a block leader, queue it if not yet visited
+static void add_leader(Analysis* an, uint16_t* work, int* nwork, uint16_t a) {
+    if (!in_range(a)) return;
+    an->map[a] |= MAP_LEADER;
+    if (!(an->map[a] & MAP_CODE)) work[(*nwork)++] = a;
+}
+
+// Recursively disassemble from the reset vector, marking code and leaders
+static void trace_code(Analysis* an, const uint8_t* mem) {
+
+    static uint16_t work[CODE_MAP_SIZE * 2 + 1];
+    int nwork = 0;
+    add_leader(an, work, &nwork, RESET_VECTOR);
+
+    while (nwork > 0) {
+        uint16_t pc = work[--nwork];
+
+        // Walk sequentially until control flow leaves
+        while (in_range(pc) && !(an->map[pc] & MAP_CODE)) {
+            uint16_t opc = fetch(mem, pc);
+            const OpInfo* op = decode_op(opc);
+            if (op == NULL) break;
+
+            an->map[pc] |= MAP_CODE;
+            an->map[pc + 1] |= MAP_OPERAND;
+            uint16_t next = pc + op_length(opc);
+            if ((op->flow & FLOW_LONG) && in_range(pc + 2)) {
+                an->map[pc + 2] |= MAP_OPERAND;
+                an->map[pc + 3] |= MAP_OPERAND;
+            }
+
+            if (op->flow & FLOW_INDIRECT) {
+                // Only the table base is known statically
+                an->map[op_target(opc)] |= MAP_INDIRECT;
+                add_leader(an, work, &nwork, op_target(opc));
+                break;
+            } else if (op->flow & FLOW_JUMP) {
+                add_leader(an, work, &nwork, op_target(opc));
+                break;
+            } else if (op->flow & FLOW_CALL) {
+                an->map[op_target(opc)] |= MAP_CALLED;
+                add_leader(an, work, &nwork, op_target(opc));
+                add_leader(an, work, &nwork, next);
+                break;
+            } else if (op->flow & (FLOW_RET | FLOW_EXIT)) {
+                break;
+            } else if (op->flow & FLOW_SKIP) {
+                add_leader(an, work, &nwork, next);
+                add_leader(an, work, &nwork, skip_target(mem, next));
+                break;
+            }
+            pc = next;
+        }
+    }
+}
+
+// Split traced code into basic blocks and link successors
+static void build_blocks(Analysis* an, const uint8_t* mem) {
+
+    an->nblocks = 0;
+    for (uint16_t a = 0; in_range(a); a++) {
+        if (!(an->map[a] & MAP_LEADER) || !(an->map[a] & MAP_CODE))
+            continue;
+
+        Block* b = &an->blocks[an->nblocks++];
+        b->start = a;
+        b->nsucc = 0;
+        b->flags = 0;
+
+        uint16_t pc = a;
+        while (true) {
+            uint16_t opc = fetch(mem, pc);
+            const OpInfo* op = decode_op(opc);
+            uint16_t next = pc + op_length(opc);
+
+            if (op->flow & FLOW_INDIRECT) {
+                b->flags |= BLOCK_INDIRECT;
+            } else if (op->flow & FLOW_JUMP) {
+                b->succ[b->nsucc++] = op_target(opc);
+            } else if (op->flow & FLOW_CALL) {
+                b->flags |= BLOCK_CALL;
+                b->succ[b->nsucc++] = op_target(opc);
+                b->succ[b->nsucc++] = next;
+            } else if (op->flow & FLOW_RET) {
+                b->flags |= BLOCK_RET;
+            } else if (op->flow & FLOW_SKIP) {
+                b->succ[b->nsucc++] = next;
+                b->succ[b->nsucc++] = skip_target(mem, next);
+            } else if (op->flow & FLOW_EXIT) {
+                b->flags |= BLOCK_HALT;
+            } else if (!in_range(next) || !(an->map[next] & MAP_CODE)) {
+                // Fell off into data or the end of memory
+                b->flags |= BLOCK_HALT;
+            } else if (an->map[next] & MAP_LEADER) {
+                b->succ[b->nsucc++] = next;
+            } else {
+                pc = next;
+                continue;
+            }
+            b->end = next;
+            break;
+        }
+    }
+}
+
+// Analyse memory image, mem must hold CODE_MAP_SIZE bytes
+void analyse(Analysis* an, const uint8_t* mem) {
+    memset(an->map, MAP_DATA, sizeof(an->map));
+    an->rom_hash = rom_hash(mem);
+    trace_code(an, mem);
+    build_blocks(an, mem);
+}
+
+// Find the block containing addr, NULL if addr is not code
+const Block* find_block(const Analysis* an, uint16_t addr) {
+    int lo = 0;
+    int hi = an->nblocks - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        const Block* b = &an->blocks[mid];
+        if (addr < b->start) hi = mid - 1;
+        else if (addr >= b->end) lo = mid + 1;
+        else return b;
+    }
+    return NULL;
+}
+
+// Write analysis to cache file
+bool save_analysis(const Analysis* an, const char* path) {
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) return false;
+
+    uint32_t header[2] = {ANALYSIS_MAGIC, ANALYSIS_VERSION};
+    bool ok = fwrite(header, sizeof(header), 1, f) == 1
+        && fwrite(&an->rom_hash, sizeof(an->rom_hash), 1, f) == 1
+        && fwrite(an->map, sizeof(an->map), 1, f) == 1
+        && fwrite(&an->nblocks, sizeof(an->nblocks), 1, f) == 1
+        && fwrite(an->blocks, sizeof(Block), an->nblocks, f) == an->nblocks;
+
+    fclose(f);
+    return ok;
+}
+
+// Read analysis from cache file, fails if it was made for another rom
+bool load_analysis(Analysis* an, const char* path, uint32_t hash) {
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return false;
+
+    uint32_t header[2];
+    bool ok = fread(header, sizeof(header), 1, f) == 1
+        && header[0] == ANALYSIS_MAGIC
+        && header[1] == ANALYSIS_VERSION
+        && fread(&an->rom_hash, sizeof(an->rom_hash), 1, f) == 1
+        && an->rom_hash == hash
+        && fread(an->map, sizeof(an->map), 1, f) == 1
+        && fread(&an->nblocks, sizeof(an->nblocks), 1, f) == 1
+        && an->nblocks <= MAX_BLOCKS
+        && fread(an->blocks, sizeof(Block), an->nblocks, f) == an->nblocks;
+
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,47 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CODE_MAP_SIZE   (0x1000)
+#define MAX_BLOCKS      (CODE_MAP_SIZE)
+#define ANALYSIS_EXT    ".c8an"
+
+// Code map flags, one entry per byte of memory
+#define MAP_DATA        (0)         // Not reached by disassembly
+#define MAP_CODE        (1 << 0)    // First byte of an instruction
+#define MAP_OPERAND     (1 << 1)    // Second byte of an instruction
+#define MAP_LEADER      (1 << 2)    // First instruction of a basic block
+#define MAP_CALLED      (1 << 3)    // Target of a call instruction
+#define MAP_INDIRECT    (1 << 4)    // Base address of an indirect jump
+
+// Basic block flags
+#define BLOCK_RET       (1 << 0)    // Ends in ret
+#define BLOCK_CALL      (1 << 1)    // Ends in call, succ[1] is return site
+#define BLOCK_INDIRECT  (1 << 2)    // Ends in indirect jump
+#define BLOCK_HALT      (1 << 3)    // Ends in exit, undefined opcode or memory end
+
+typedef struct Block {
+    uint16_t start;         // Address of first instruction
+    uint16_t end;           // Address after last instruction
+    uint16_t succ[2];       // Successor block addresses
+    uint8_t  nsucc;         // Number of successors
+    uint8_t  flags;         // Block flags
+} Block;
+
+typedef struct Analysis {
+    uint32_t rom_hash;                  // Hash of analysed program bytes
+    uint8_t  map[CODE_MAP_SIZE];        // Code/data map
+    uint16_t nblocks;                   // Number of basic blocks
+    Block    blocks[MAX_BLOCKS];        // Basic blocks, sorted by address
+} Analysis;
+
+uint32_t rom_hash(const uint8_t* mem);                      // Hash program
+void analyse(Analysis* an, const uint8_t* mem);             // Analyse image
+const Block* find_block(const Analysis* an, uint16_t addr); // Block at addr
+
+bool save_analysis(const Analysis* an, const char* path);   // Write cache
+bool load_analysis(Analysis* an, const char* path, uint32_t hash);
+
+#endif  // ANALYSIS_H
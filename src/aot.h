@@ -0,0 +1,14 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "chip8.h"
+
+// Statically recompiled rom, generated by chip8-aot
+typedef struct AotModule {
+    const char* rom;                        // Rom the module was built from
+    uint32_t rom_hash;                      // rom_hash() of that rom
+    long (*run)(Chip8* chip, long budget);  // Run up to budget instructions
+    const uint8_t* code_map;                // Nonzero for translated bytes
+} AotModule;
+
+#endif  // AOT_H
@@ -0,0 +1,115 @@
+#include <math.h>
+#include <time.h>
+
+#include "audio.h"
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Generate samples up to position, into the ring. A full ring drops them,
+// except for WAV output which waits for the writer
+static void generate(Audio* a, const Chip8* chip, long upto) {
+
+    if (upto <= a->produced) return;
+
+    // XO-CHIP plays the pattern buffer as 1 bit samples at the pitch rate
+    bool xo = chip->mode == MODE_XOCHIP;
+    double step = xo ? 4000.0 * pow(2.0, (chip->pitch - 64) / 48.0) / AUDIO_RATE
+                     : AUDIO_TONE / AUDIO_RATE;
+    double wrap = xo ? 128.0 : 1.0;
+
+    unsigned head = atomic_load_explicit(&a->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&a->tail, memory_order_acquire);
+    for (; a->produced < upto; a->produced++) {
+
+        bool high;
+        if (xo) {
+            int bit = (int)a->phase;
+            high = (chip->pattern[bit >> 3] >> (7 - (bit & 7))) & 1;
+        } else {
+            high = a->phase < 0.5;
+        }
+        a->phase += step;
+        if (a->phase >= wrap) a->phase -= wrap;
+
+        if (head - tail == a->size) {
+            atomic_store_explicit(&a->head, head, memory_order_release);
+            tail = atomic_load_explicit(&a->tail, memory_order_acquire);
+            while (a->sink == AUDIO_WAV && head - tail == a->size) {
+                struct timespec d = {0, 100000};
+                nanosleep(&d, NULL);
+                tail = atomic_load_explicit(&a->tail, memory_order_acquire);
+            }
+            if (head - tail == a->size) {
+                a->overruns++;
+                continue;
+            }
+        }
+
+        int16_t v = !a->level ? 0 : high ? AUDIO_VOLUME : -AUDIO_VOLUME;
+        a->ring[head & (a->size - 1)] = v;
+        head++;
+    }
+    atomic_store_explicit(&a->head, head, memory_order_release);
+}
+
+// Fraction of the frame run so far
+static double frame_offset(const Chip8* chip) {
+    double per_frame = chip->cycle_f / chip->clock_f;
+    double f = (chip->frame_exec + chip->frame_yield) / per_frame;
+    return f < 1 ? f : 1;
+}
+
+// Switch tone at the next sample, probing the edge if none is in flight.
+// The edge is due offset frames after the frame started in wall time
+static void set_level(Audio* a, bool on, double offset) {
+
+    if (on == a->level) return;
+    a->level = on;
+    a->edges++;
+
+    if (a->measure && !atomic_load_explicit(&a->probe_set, memory_order_acquire)) {
+        a->probe = atomic_load_explicit(&a->head, memory_order_relaxed);
+        a->probe_wall = a->frame_wall + offset * a->per_frame / AUDIO_RATE;
+        atomic_store_explicit(&a->probe_set, true, memory_order_release);
+    }
+}
+
+// Sound timer started or stopped, timestamped by the instruction's place
+// in the frame so batched frames keep their timing
+void audio_edge(Audio* audio, const Chip8* chip, bool on) {
+    double offset = frame_offset(chip);
+    generate(audio, chip, audio->frame_base + offset * audio->per_frame);
+    set_level(audio, on, offset);
+}
+
+// Pattern or pitch is about to change, samples up to the instruction's place
+// in the frame keep the old ones
+void audio_tone(Audio* audio, const Chip8* chip) {
+    double offset = frame_offset(chip);
+    generate(audio, chip, audio->frame_base + offset * audio->per_frame);
+}
+
+// Frame is about to run as one batch, its timeline starts now
+void audio_batch(Audio* audio) {
+    if (audio->measure) audio->frame_wall = now();
+}
+
+// Keep the ring fed while a frame is executed at its own pace
+void sync_audio(Audio* audio, const Chip8* chip) {
+    long upto = audio->frame_base + frame_offset(chip) * audio->per_frame;
+    if (upto - audio->produced >= AUDIO_SYNC) generate(audio, chip, upto);
+}
+
+// Finish frame's samples at the clock edge, called from send_clock() after
+// the timers count down
+void audio_frame(Audio* audio, const Chip8* chip) {
+    audio->frame_base += audio->per_frame;
+    generate(audio, chip, audio->frame_base);
+    set_level(audio, chip->sound > 0, 1);
+    if (audio->measure) audio->frame_wall = now();
+}
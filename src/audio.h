@@ -0,0 +1,74 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+
+#define AUDIO_RATE          (44100)     // Samples per second
+#define AUDIO_TONE          (440.0)     // Buzzer frequency
+#define AUDIO_VOLUME        (6000)      // Square wave amplitude
+#define AUDIO_PERIOD        (256)       // Default samples per callback
+#define AUDIO_SYNC          (64)        // Samples generated at a time in loop()
+#define AUDIO_PATH_SIZE     (1024)
+
+typedef enum {
+    AUDIO_DEVICE,           // Sound card through a raylib stream callback
+    AUDIO_NULL,             // Discarded by a thread pulling at device pace
+    AUDIO_WAV,              // Every sample written to a WAV file
+} AudioSink;
+
+typedef struct Audio {
+
+    // Output
+    AudioSink sink;
+    char path[AUDIO_PATH_SIZE];     // WAV file
+    unsigned period;                // Samples per callback
+    bool measure;                   // Time on/off edges to output
+
+    // Single producer, single consumer ring of samples
+    int16_t* ring;
+    unsigned size;                  // Capacity, power of two
+    atomic_uint head;               // Samples written, producer owned
+    atomic_uint tail;               // Samples read, consumer owned
+    atomic_bool stop;               // Sink thread should drain and exit
+    pthread_t thread;               // Null and WAV sinks
+
+    // Producer state, emulation thread only
+    double per_frame;               // Samples per clock
+    double frame_base;              // Sample position of frame start
+    long produced;                  // Samples generated
+    bool level;                     // Sound on at produced
+    double phase;                   // Oscillator phase, tone cycles or bits
+    long edges;                     // On/off transitions
+    long overruns;                  // Samples dropped on a full ring
+
+    // Latency probe, one edge in flight
+    atomic_bool probe_set;          // Edge waiting to be output
+    unsigned probe;                 // Ring position of edge sample
+    double probe_wall;              // Wall time the edge is due
+    double frame_wall;              // Wall time the frame started
+
+    // Consumer statistics, read after the sink stops
+    long consumed;                  // Samples output
+    long underruns;                 // Callbacks short of samples
+    long measured;                  // Edges timed
+    double latency_sum;
+    double latency_max;
+    long late;                      // Edges output more than a frame late
+    FILE* wav;
+    bool failed;                    // Output could not be written
+
+} Audio;
+
+Audio* open_audio(const char* sink, unsigned size, unsigned period,
+                  float clock_f, bool measure);
+void audio_edge(Audio* audio, const Chip8* chip, bool on);
+void audio_tone(Audio* audio, const Chip8* chip);
+void sync_audio(Audio* audio, const Chip8* chip);
+void audio_batch(Audio* audio);
+void audio_frame(Audio* audio, const Chip8* chip);
+void close_audio(Audio* audio);
+
+#endif  // AUDIO_H
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../include/raylib.h"
+#include "audio.h"
+
+#define WAV_HEADER_SIZE (44)
+
+// The raylib callback takes no context, one device stream at a time
+static Audio* device_audio;
+static AudioStream device_stream;
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Store little endian value of n bytes
+static void put_le(uint8_t* p, uint32_t v, int n) {
+    for (int k = 0; k < n; k++) p[k] = v >> (8 * k);
+}
+
+// Write 16bit mono PCM header for given number of data bytes
+static bool write_wav_header(FILE* f, uint32_t data) {
+    uint8_t h[WAV_HEADER_SIZE];
+    memcpy(h, "RIFF", 4);
+    put_le(h + 4, 36 + data, 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le(h + 16, 16, 4);                  // Format chunk size
+    put_le(h + 20, 1, 2);                   // PCM
+    put_le(h + 22, 1, 2);                   // Channels
+    put_le(h + 24, AUDIO_RATE, 4);
+    put_le(h + 28, AUDIO_RATE * 2, 4);      // Bytes per second
+    put_le(h + 32, 2, 2);                   // Bytes per sample
+    put_le(h + 34, 16, 2);                  // Bits per sample
+    memcpy(h + 36, "data", 4);
+    put_le(h + 40, data, 4);
+    return fseek(f, 0, SEEK_SET) == 0 && fwrite(h, 1, sizeof(h), f) == sizeof(h);
+}
+
+// Take up to n samples from the ring, padding with silence if pad is set.
+// Times the probed edge if it is among them. Returns samples taken
+static unsigned consume(Audio* a, int16_t* out, unsigned n, bool pad) {
+
+    unsigned tail = atomic_load_explicit(&a->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&a->head, memory_order_acquire);
+    unsigned got = head - tail < n ? head - tail : n;
+    for (unsigned k = 0; k < got; k++)
+        out[k] = a->ring[(tail + k) & (a->size - 1)];
+
+    // Edge latency runs to when its sample is handed to the sink
+    if (a->measure && atomic_load_explicit(&a->probe_set, memory_order_acquire)) {
+        int ahead = (int)(a->probe - tail);
+        if (ahead < 0) {
+            atomic_store_explicit(&a->probe_set, false, memory_order_release);
+        } else if ((unsigned)ahead < got) {
+            double latency = now() + (double)ahead / AUDIO_RATE - a->probe_wall;
+            a->measured++;
+            a->latency_sum += latency;
+            if (latency > a->latency_max) a->latency_max = latency;
+            if (latency > a->per_frame / AUDIO_RATE) a->late++;
+            atomic_store_explicit(&a->probe_set, false, memory_order_release);
+        }
+    }
+
+    atomic_store_explicit(&a->tail, tail + got, memory_order_release);
+    a->consumed += got;
+
+    if (pad && got < n) {
+        memset(out + got, 0, (n - got) * sizeof(int16_t));
+        a->underruns++;
+    }
+    return got;
+}
+
+// Sound card callback, runs on the audio thread
+static void device_callback(void* buffer, unsigned int frames) {
+    consume(device_audio, buffer, frames, true);
+}
+
+// Null sink, pulls a period at a time at the pace of a sound card
+static void* null_main(void* arg) {
+
+    Audio* a = arg;
+    int16_t* out = malloc(a->period * sizeof(int16_t));
+    double deadline = now();
+    while (!atomic_load_explicit(&a->stop, memory_order_acquire)) {
+
+        // Absolute deadlines, so oversleeping doesn't drift the pace
+        deadline += (double)a->period / AUDIO_RATE;
+        double wait = deadline - now();
+        if (wait > 0) {
+            struct timespec d = {(time_t)wait, (long)((wait - (time_t)wait) * 1e9)};
+            nanosleep(&d, NULL);
+        }
+        consume(a, out, a->period, true);
+    }
+    free(out);
+    return NULL;
+}
+
+// WAV sink, drains the ring to file until stopped and empty
+static void* wav_main(void* arg) {
+
+    Audio* a = arg;
+    int16_t* out = malloc(a->size * sizeof(int16_t));
+    uint8_t* bytes = malloc(a->size * 2);
+    while (true) {
+        unsigned got = consume(a, out, a->size, false);
+        if (got == 0) {
+            if (atomic_load_explicit(&a->stop, memory_order_acquire)) break;
+            struct timespec d = {0, 1000000};
+            nanosleep(&d, NULL);
+            continue;
+        }
+        for (unsigned k = 0; k < got; k++) put_le(bytes + 2 * k, out[k], 2);
+        if (fwrite(bytes, 2, got, a->wav) != got) a->failed = true;
+    }
+    free(bytes);
+    free(out);
+    return NULL;
+}
+
+// Start sound output to sink: "device", "null" or a .wav path. Ring size
+// is rounded up to a power of two that holds a frame and a period, size 0
+// gives the smallest such ring for the clock rate
+Audio* open_audio(const char* sink, unsigned size, unsigned period,
+                  float clock_f, bool measure) {
+
+    Audio* a = calloc(1, sizeof(Audio));
+    if (a == NULL) return NULL;
+
+    size_t len = strlen(sink);
+    if (strcmp(sink, "device") == 0) {
+        a->sink = AUDIO_DEVICE;
+    } else if (strcmp(sink, "null") == 0) {
+        a->sink = AUDIO_NULL;
+    } else if (len > 4 && strcmp(sink + len - 4, ".wav") == 0) {
+        a->sink = AUDIO_WAV;
+        snprintf(a->path, sizeof(a->path), "%s", sink);
+    } else {
+        free(a);
+        return NULL;
+    }
+
+    a->period = period > 0 ? period : AUDIO_PERIOD;
+    a->measure = measure;
+    a->per_frame = AUDIO_RATE / clock_f;
+    a->size = 1;
+    while (a->size < size || a->size < a->per_frame + a->period) a->size <<= 1;
+    a->ring = calloc(a->size, sizeof(int16_t));
+    atomic_init(&a->head, 0);
+    atomic_init(&a->tail, 0);
+    atomic_init(&a->stop, false);
+    atomic_init(&a->probe_set, false);
+
+    bool ok = a->ring != NULL;
+    if (ok && a->sink == AUDIO_DEVICE) {
+        if (device_audio != NULL) ok = false;
+        else {
+            device_audio = a;
+            InitAudioDevice();
+            SetAudioStreamBufferSizeDefault(a->period);
+            device_stream = LoadAudioStream(AUDIO_RATE, 16, 1);
+            SetAudioStreamCallback(device_stream, device_callback);
+            PlayAudioStream(device_stream);
+        }
+    } else if (ok && a->sink == AUDIO_NULL) {
+        ok = pthread_create(&a->thread, NULL, null_main, a) == 0;
+    } else if (ok) {
+        a->wav = fopen(a->path, "wb");
+        ok = a->wav != NULL && write_wav_header(a->wav, 0)
+             && pthread_create(&a->thread, NULL, wav_main, a) == 0;
+    }
+
+    if (!ok) {
+        if (a->wav != NULL) fclose(a->wav);
+        free(a->ring);
+        free(a);
+        return NULL;
+    }
+    return a;
+}
+
+// Stop output, finish WAV file and report statistics
+void close_audio(Audio* audio) {
+
+    if (audio->sink == AUDIO_DEVICE) {
+        StopAudioStream(device_stream);
+        UnloadAudioStream(device_stream);
+        CloseAudioDevice();
+        device_audio = NULL;
+    } else {
+        atomic_store_explicit(&audio->stop, true, memory_order_release);
+        pthread_join(audio->thread, NULL);
+    }
+
+    if (audio->wav != NULL) {
+        uint32_t data = audio->consumed * 2;
+        if (!write_wav_header(audio->wav, data)) audio->failed = true;
+        if (fclose(audio->wav) != 0) audio->failed = true;
+    }
+
+    printf("audio: %ld samples, %ld edges, %ld underruns, %ld overruns, "
+           "ring %u, period %u%s\n", audio->consumed, audio->edges,
+           audio->underruns, audio->overruns, audio->size, audio->period,
+           audio->failed ? ", write FAILED" : "");
+    if (audio->measure) {
+        printf("audio: %ld edges timed, latency avg %.2f ms, max %.2f ms, "
+               "%ld over one frame\n", audio->measured,
+               audio->measured ? 1000 * audio->latency_sum / audio->measured : 0,
+               1000 * audio->latency_max, audio->late);
+    }
+
+    free(audio->ring);
+    free(audio);
+}
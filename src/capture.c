@@ -0,0 +1,329 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "capture.h"
+
+#define QUEUE_MASK (CAPTURE_QUEUE_SIZE - 1)
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Expand frame to 8bit luma at output scale, one grey level per plane mix
+static void scale_frame(const Capture* cap, const Frame* vid, uint8_t* out) {
+    static const uint8_t luma[] = {0x00, 0xff, 0xaa, 0x55};
+    int w = SCREEN_WIDTH * cap->scale;
+    for (int y = 0; y < SCREEN_HEIGHT * cap->scale; y++) {
+        for (int x = 0; x < w; x++)
+            out[y * w + x] = luma[get_pixel(vid, x / cap->scale,
+                                            y / cap->scale)];
+    }
+}
+
+static uint32_t crc_table[256];
+
+// Build png crc table
+static void init_crc(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+// Update png crc
+static uint32_t crc(uint32_t c, const uint8_t* buf, size_t len) {
+    for (size_t i = 0; i < len; i++)
+        c = crc_table[(c ^ buf[i]) & 0xff] ^ (c >> 8);
+    return c;
+}
+
+// Store 32bit big endian
+static void put32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+// Write png chunk, returns bytes written
+static long png_chunk(FILE* f, const char* type, const uint8_t* data,
+                      uint32_t len) {
+    uint8_t head[8];
+    put32(head, len);
+    memcpy(head + 4, type, 4);
+    uint32_t c = crc(0xffffffffu, head + 4, 4);
+    c = crc(c, data, len) ^ 0xffffffffu;
+    uint8_t tail[4];
+    put32(tail, c);
+
+    fwrite(head, 1, 8, f);
+    fwrite(data, 1, len, f);
+    fwrite(tail, 1, 4, f);
+    return len + 12;
+}
+
+// Write 8bit grayscale png using uncompressed deflate blocks
+static long write_png(const char* path, const uint8_t* pix, int w, int h) {
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) return -1;
+
+    // Filter byte per scanline, then zlib stream of stored blocks
+    size_t raw_len = (size_t)h * (w + 1);
+    size_t nblocks = (raw_len + 0xfffe) / 0xffff;
+    uint8_t* idat = malloc(2 + raw_len + 5 * nblocks + 4);
+    uint8_t* raw = malloc(raw_len);
+    if (idat == NULL || raw == NULL) {
+        free(raw);
+        free(idat);
+        fclose(f);
+        return -1;
+    }
+    for (int y = 0; y < h; y++) {
+        raw[y * (w + 1)] = 0;
+        memcpy(raw + y * (w + 1) + 1, pix + y * w, w);
+    }
+
+    size_t p = 0;
+    idat[p++] = 0x78;
+    idat[p++] = 0x01;
+    uint32_t a = 1, b = 0;
+    for (size_t off = 0; off < raw_len; off += 0xffff) {
+        uint16_t len = raw_len - off < 0xffff ? raw_len - off : 0xffff;
+        idat[p++] = off + len == raw_len;
+        idat[p++] = len & 0xff;
+        idat[p++] = len >> 8;
+        idat[p++] = ~len & 0xff;
+        idat[p++] = (~len >> 8) & 0xff;
+        memcpy(idat + p, raw + off, len);
+        p += len;
+        for (size_t i = off; i < off + len; i++) {
+            a = (a + raw[i]) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    put32(idat + p, (b << 16) | a);
+    p += 4;
+
+    uint8_t ihdr[13] = {0};
+    put32(ihdr, w);
+    put32(ihdr + 4, h);
+    ihdr[8] = 8;    // Bit depth
+    ihdr[9] = 0;    // Grayscale
+
+    static const uint8_t sig[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    fwrite(sig, 1, 8, f);
+    long bytes = 8;
+    bytes += png_chunk(f, "IHDR", ihdr, sizeof(ihdr));
+    bytes += png_chunk(f, "IDAT", idat, p);
+    bytes += png_chunk(f, "IEND", NULL, 0);
+
+    free(raw);
+    free(idat);
+    if (fclose(f) != 0) return -1;
+    return bytes;
+}
+
+// Writer thread, drains queue until end of stream marker
+static void* writer_main(void* arg) {
+
+    Capture* cap = arg;
+    int w = SCREEN_WIDTH * cap->scale;
+    int h = SCREEN_HEIGHT * cap->scale;
+    uint8_t* scaled = calloc(w, h);
+    long next = 0;
+    FILE* y4m = NULL;
+
+    if (cap->format == CAPTURE_Y4M) {
+        y4m = fopen(cap->path, "wb");
+        if (y4m == NULL) cap->failed = true;
+        else cap->bytes += fprintf(y4m, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 Cmono\n",
+                                   w, h, cap->fps);
+    } else {
+        init_crc();
+    }
+
+    while (true) {
+        unsigned tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+        unsigned head = atomic_load_explicit(&cap->head, memory_order_acquire);
+        if (tail == head) {
+            struct timespec d = {0, 1000000};
+            nanosleep(&d, NULL);
+            continue;
+        }
+
+        CaptureFrame* f = &cap->queue[tail & QUEUE_MASK];
+        double start = now();
+
+        if (y4m != NULL) {
+            // Repeat previous frame over deduplicated and dropped frames
+            for (; next < f->index; next++) {
+                cap->bytes += fprintf(y4m, "FRAME\n");
+                cap->bytes += fwrite(scaled, 1, w * h, y4m);
+                cap->written++;
+            }
+            if (!f->end) {
+                scale_frame(cap, &f->vid, scaled);
+                cap->bytes += fprintf(y4m, "FRAME\n");
+                cap->bytes += fwrite(scaled, 1, w * h, y4m);
+                cap->written++;
+                next = f->index + 1;
+            }
+        } else if (!f->end && !cap->failed) {
+            char name[CAPTURE_PATH_SIZE + 32];
+            snprintf(name, sizeof(name), cap->path, f->index);
+            scale_frame(cap, &f->vid, scaled);
+            long n = write_png(name, scaled, w, h);
+            if (n < 0) cap->failed = true;
+            else {
+                cap->bytes += n;
+                cap->written++;
+            }
+        }
+
+        cap->busy += now() - start;
+        bool end = f->end;
+        atomic_store_explicit(&cap->tail, tail + 1, memory_order_release);
+        if (end) break;
+    }
+
+    if (y4m != NULL && fclose(y4m) != 0) cap->failed = true;
+    free(scaled);
+    return NULL;
+}
+
+// Turn png name pattern into a format taking only the frame number. The
+// pattern may hold one %d or %ld with flags and width, %% is a literal %
+// and any other % is escaped. Without a conversion it is a prefix for
+// %06ld.png. Returns false if there are several conversions or no room
+static bool png_format(char* out, size_t size, const char* pattern) {
+
+    size_t n = 0;
+    int conversions = 0;
+    char tmp[32];
+
+    for (const char* p = pattern; *p; p++) {
+        const char* add = tmp;
+        if (*p != '%') {
+            tmp[0] = *p;
+            tmp[1] = '\0';
+        } else if (p[1] == '%') {
+            add = "%%";
+            p++;
+        } else {
+            // Flags and width, then d or ld
+            size_t f = 1 + strspn(p + 1, "-+ #0");
+            f += strspn(p + f, "0123456789");
+            size_t l = p[f] == 'l';
+            if (p[f + l] == 'd' && f < sizeof(tmp) - 4) {
+                snprintf(tmp, sizeof(tmp), "%.*sld", (int)f, p);
+                p += f + l;
+                conversions++;
+            } else {
+                add = "%%";
+            }
+        }
+        size_t len = strlen(add);
+        if (n + len >= size) return false;
+        memcpy(out + n, add, len);
+        n += len;
+    }
+    out[n] = '\0';
+
+    if (conversions == 0) {
+        if (n + sizeof("%06ld.png") > size) return false;
+        strcpy(out + n, "%06ld.png");
+        return true;
+    }
+    return conversions == 1;
+}
+
+// Start capturing frames. Paths ending in .y4m write one video stream,
+// anything else is a png name pattern taking the frame number (%ld)
+Capture* open_capture(const char* path, int scale, int fps) {
+
+    Capture* cap = calloc(1, sizeof(Capture));
+    if (cap == NULL) return NULL;
+
+    size_t len = strlen(path);
+    cap->format = len > 4 && strcmp(path + len - 4, ".y4m") == 0
+                ? CAPTURE_Y4M : CAPTURE_PNG;
+    if (cap->format == CAPTURE_Y4M)
+        snprintf(cap->path, sizeof(cap->path), "%s", path);
+    else if (!png_format(cap->path, sizeof(cap->path), path)) {
+        free(cap);
+        return NULL;
+    }
+
+    cap->scale = scale > 0 ? scale : 1;
+    cap->fps = fps;
+    atomic_init(&cap->head, 0);
+    atomic_init(&cap->tail, 0);
+
+    if (pthread_create(&cap->writer, NULL, writer_main, cap) != 0) {
+        free(cap);
+        return NULL;
+    }
+    return cap;
+}
+
+// Queue a slot for the writer, false if the queue is full
+static bool enqueue(Capture* cap, long index, const Frame* vid, bool end) {
+    unsigned head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&cap->tail, memory_order_acquire);
+    if (head - tail == CAPTURE_QUEUE_SIZE) return false;
+
+    CaptureFrame* f = &cap->queue[head & QUEUE_MASK];
+    f->index = index;
+    f->end = end;
+    if (vid != NULL) f->vid = *vid;
+    atomic_store_explicit(&cap->head, head + 1, memory_order_release);
+    return true;
+}
+
+// True if frames look the same, comparing fields rather than padding
+static bool same_frame(const Frame* a, const Frame* b) {
+    return a->hires == b->hires
+        && memcmp(a->rows, b->rows, sizeof(a->rows)) == 0;
+}
+
+// Offer completed frame, called from send_clock(). Never blocks
+void capture_frame(Capture* cap, const Chip8* chip) {
+
+    long index = cap->frames++;
+
+    // Still screens cost a compare and nothing else
+    if (cap->have_last && same_frame(&cap->last, &chip->vid))
+        return;
+
+    if (!enqueue(cap, index, &chip->vid, false)) {
+        cap->dropped++;
+        return;
+    }
+
+    cap->last = chip->vid;
+    cap->have_last = true;
+    cap->unique++;
+}
+
+// Flush queue, stop writer and report statistics
+void close_capture(Capture* cap) {
+
+    // End marker carries the frame count so trailing stills get written
+    while (!enqueue(cap, cap->frames, NULL, true)) {
+        struct timespec d = {0, 1000000};
+        nanosleep(&d, NULL);
+    }
+    pthread_join(cap->writer, NULL);
+
+    printf("capture: %ld frames, %ld unique, %ld dropped, %ld written\n",
+           cap->frames, cap->unique, cap->dropped, cap->written);
+    printf("capture: %.1f MB in %.3fs writer time (%.0f frames/s)%s\n",
+           cap->bytes / 1e6, cap->busy,
+           cap->busy > 0 ? cap->written / cap->busy : 0.0,
+           cap->failed ? ", write FAILED" : "");
+
+    free(cap);
+}
@@ -0,0 +1,56 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+
+#define CAPTURE_QUEUE_SIZE  (64)        // Power of two
+#define CAPTURE_PATH_SIZE   (1024)
+
+typedef enum {
+    CAPTURE_Y4M,            // Single raw YUV4MPEG2 stream
+    CAPTURE_PNG,            // One png per changed frame
+} CaptureFormat;
+
+typedef struct CaptureFrame {
+    long index;                             // Frame number
+    bool end;                               // End of stream, no frame
+    Frame vid;                              // Copy of video memory
+} CaptureFrame;
+
+typedef struct Capture {
+
+    // Output
+    CaptureFormat format;
+    char path[CAPTURE_PATH_SIZE];   // Y4M file, or png name pattern
+    int scale;                      // Output pixels per chip-8 pixel
+    int fps;                        // Frames per second
+
+    // Single producer, single consumer queue
+    CaptureFrame queue[CAPTURE_QUEUE_SIZE];
+    atomic_uint head;               // Next slot to write, producer owned
+    atomic_uint tail;               // Next slot to read, consumer owned
+    pthread_t writer;
+
+    // Producer state, emulation thread only
+    Frame last;                     // Last queued frame
+    bool have_last;
+    long frames;                    // Frames offered
+    long unique;                    // Frames queued after dedup
+    long dropped;                   // Frames lost to a full queue
+
+    // Writer statistics, read after join
+    long written;                   // Frames written including repeats
+    long bytes;                     // Bytes written
+    double busy;                    // Seconds spent encoding and writing
+    bool failed;                    // Output could not be written
+
+} Capture;
+
+Capture* open_capture(const char* path, int scale, int fps);
+void capture_frame(Capture* cap, const Chip8* chip);
+void close_capture(Capture* cap);
+
+#endif  // CAPTURE_H
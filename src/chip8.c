@@ -2,14 +2,53 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "chip8.h"
 #include "opcodes.h"
-#include "display.h"
-
-#define LOG(...) LOG_HELPER(__VA_ARGS__, "")
-#define LOG_HELPER(opc, str, ...) \
-     printf("%04d: 0x%04x - " str "%s\n", chip->pc - 2, opc, __VA_ARGS__)
+#include "decode.h"
+#include "analysis.h"
+#include "debug.h"
+#include "debug_server.h"
+#include "capture.h"
+#include "stream.h"
+#include "audio.h"
+#include "input.h"
+#include "metrics.h"
+#include "aot.h"
+#include "hash.h"
+
+// Print disassembly of executing instruction and the registers it reads
+static void trace(Chip8* chip, uint16_t opc) {
+    char text[32];
+    disassemble(opc, text, sizeof(text));
+
+    char regs[48] = "";
+    int n = 0;
+    const OpInfo* op = decode_op(opc);
+    if (op != NULL) {
+        uint8_t x = (opc & 0x0f00) >> 8;
+        uint8_t y = (opc & 0x00f0) >> 4;
+        if (strstr(op->operands, "[v0]")) {
+            // The jumping quirk makes Bnnn add vX instead
+            uint8_t r = 0;
+            if ((opc & 0xf000) == 0xb000 && chip->quirk_jump) {
+                r = x;
+                snprintf(text, sizeof(text), "jp 0x%03x + [v%x]", opc & 0xfff, r);
+            }
+            n += snprintf(regs + n, sizeof(regs) - n, " [v%x]=%d", r, chip->reg[r]);
+        }
+        if (strstr(op->operands, "[vX]"))
+            n += snprintf(regs + n, sizeof(regs) - n, " [v%x]=%d", x, chip->reg[x]);
+        if (strstr(op->operands, "[vY]"))
+            n += snprintf(regs + n, sizeof(regs) - n, " [v%x]=%d", y, chip->reg[y]);
+
+        // Sprites are read from i too
+        if (strstr(op->operands, "[i]") || (opc & 0xf000) == 0xd000)
+            n += snprintf(regs + n, sizeof(regs) - n, " [i]=%d", chip->i);
+    }
+    printf("%04d: 0x%04x - %s%s%s\n", chip->pc, opc, text, n ? " " : "", regs);
+}
 
 // Initialize Chip8 VM
 void init_chip8(Chip8* chip) {
@@ -39,22 +78,69 @@ void init_chip8(Chip8* chip) {
     for (uint8_t i = 0; i < 16 * 5; i++)
         chip->ram[FONT_VECTOR + i] = font[i];
 
-    // Configure quirks for classic chip-8
-    chip->quirk_vf_reset = true;
-    chip->quirk_memory = true;
-    chip->quirk_disp_wait = true;
-    chip->quirk_clip = true;
-    chip->quirk_shift = false;
-    chip->quirk_jump = false;
+    // SUPER-CHIP 8x10 digits, with XO-CHIP's A-F
+    uint8_t big_font[] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
+    for (uint8_t i = 0; i < 16 * 10; i++)
+        chip->ram[BIG_FONT_VECTOR + i] = big_font[i];
+
+    // Single plane, low resolution
+    chip->planes = 1;
+    chip->vid.hires = false;
+
+    // XO-CHIP audio starts as a 250Hz square wave at the base pitch
+    for (int b = 0; b < 16; b++) chip->pattern[b] = b & 1 ? 0xff : 0x00;
+    chip->pitch = 64;
+
+    // Configure memory and quirks for classic chip-8
+    set_mode(chip, MODE_CHIP8);
 
     // Configure Clock/Cycle Frequencies
     chip->clock_f = 60.0;
     chip->cycle_f = 700;
     chip->clocks = 0;
     chip->cycles = 0;
+    chip->yielded = 0;
+    chip->frame_exec = chip->frame_yield = 0;
+    chip->last_exec = chip->last_yield = 0;
     
     // Default State
     chip->state = STATE_HALTED;
+    chip->trace = true;
+    chip->vblank_wait = false;
+    chip->debug_ui = true;
+    chip->analysis = NULL;
+    chip->debug = NULL;
+    chip->exec = cycle;
+    chip->server = NULL;
+    chip->aot = NULL;
+    chip->aot_code = NULL;
+    chip->capture = NULL;
+    chip->stream = NULL;
+    chip->input = NULL;
+    chip->metrics = NULL;
+    chip->audio = NULL;
+    chip->throttle = true;
+    chip->hashing = false;
+
+    // Fixed seed, so runs from the same inputs are reproducible
+    chip->rng = 0x2545f491;
 }
 
 // Load a rom from file
@@ -67,15 +153,126 @@ void load_rom(Chip8* chip, const char* path) {
 
     // read rom into ram at reset vector
     uint16_t p = RESET_VECTOR;
-    while (p < 0xfff && fread(chip->ram + p, 1, 1, f)) {
+    while (p <= chip->ram_mask && fread(chip->ram + p, 1, 1, f)) {
         p++;
     }
+    mirror_guard(chip);
+    rehash_state(chip);
+}
+
+// Copy low memory into the guard bytes, after writes that bypass opcodes
+void mirror_guard(Chip8* chip) {
+    memcpy(chip->ram + chip->ram_mask + 1, chip->ram, RAM_GUARD);
+}
+
+// Select instruction set, memory size and the quirks that go with them
+void set_mode(Chip8* chip, ChipMode mode) {
+
+    chip->mode = mode;
+    chip->ram_mask = mode == MODE_XOCHIP ? XO_RAM_MASK : RAM_MASK;
+
+    switch (mode) {
+    case MODE_CHIP8:
+        chip->quirk_vf_reset = true;
+        chip->quirk_memory = true;
+        chip->quirk_disp_wait = true;
+        chip->quirk_clip = true;
+        chip->quirk_shift = false;
+        chip->quirk_jump = false;
+        break;
+    case MODE_SCHIP:
+        chip->quirk_vf_reset = false;
+        chip->quirk_memory = false;
+        chip->quirk_disp_wait = false;
+        chip->quirk_clip = true;
+        chip->quirk_shift = true;
+        chip->quirk_jump = true;
+        break;
+    case MODE_XOCHIP:
+        chip->quirk_vf_reset = false;
+        chip->quirk_memory = true;
+        chip->quirk_disp_wait = false;
+        chip->quirk_clip = false;
+        chip->quirk_shift = false;
+        chip->quirk_jump = false;
+        break;
+    }
+
+    mirror_guard(chip);
+    rehash_state(chip);
+}
+
+// Load cached static analysis for rom, or analyse it now
+void attach_analysis(Chip8* chip, const char* path) {
+
+    // Analysis works on a full 4K image
+    uint8_t mem[CODE_MAP_SIZE] = {0};
+    memcpy(mem, chip->ram, RAM_SIZE);
+
+    Analysis* an = malloc(sizeof(Analysis));
+    assert(an != NULL && "Unable to allocate analysis!");
+
+    char cache[1024];
+    snprintf(cache, sizeof(cache), "%s" ANALYSIS_EXT, path);
+    if (!load_analysis(an, cache, rom_hash(mem)))
+        analyse(an, mem);
+
+    chip->analysis = an;
+}
+
+// Run recompiled module if it was built from the loaded rom
+bool attach_aot(Chip8* chip, const AotModule* mod) {
+
+    // Modules are built for 4K memory
+    if (chip->ram_mask != RAM_MASK) return false;
+
+    uint8_t mem[CODE_MAP_SIZE] = {0};
+    memcpy(mem, chip->ram, RAM_SIZE);
+    if (rom_hash(mem) != mod->rom_hash) return false;
+
+    chip->aot = mod->run;
+    chip->aot_code = mod->code_map;
+    return true;
+}
+
+// Drop recompiled code if any of len bytes from addr were translated, for
+// writes that bypass set_ram()
+void invalidate_aot(Chip8* chip, uint16_t addr, unsigned len) {
+    for (unsigned k = 0; k < len && chip->aot != NULL; k++)
+        if (chip->aot_code[(addr + k) & RAM_MASK]) chip->aot = NULL;
+}
+
+// Count finished frame and hand it to the outputs, at the clock edge or
+// when the frame cache replays a frame
+void end_frame(Chip8* chip) {
+    if (chip->metrics != NULL) metrics_clock(chip->metrics, chip);
+    chip->last_exec = chip->frame_exec;
+    chip->last_yield = chip->frame_yield;
+    chip->frame_exec = chip->frame_yield = 0;
+
+    if (chip->capture != NULL) capture_frame(chip->capture, chip);
+    if (chip->stream != NULL) stream_frame(chip->stream, chip);
+    if (chip->audio != NULL) audio_frame(chip->audio, chip);
 }
 
 // Trigger clock signal, expect to be called at 60Hz
 void send_clock(Chip8* chip) {
     if (chip->delay > 0) chip->delay--;
     if (chip->sound > 0) chip->sound--;
+
+    // Vblank releases a waiting draw, the frame is complete
+    chip->vblank_wait = false;
+    end_frame(chip);
+}
+
+// Instruction sets line up with the modes that first support them
+_Static_assert(ISA_CHIP8 == MODE_CHIP8 && ISA_SCHIP == MODE_SCHIP &&
+               ISA_XOCHIP == MODE_XOCHIP, "ISA and mode numbering differ");
+
+// True if opcode is undefined in the current mode
+static bool isa_missing(const Chip8* chip, uint16_t opc) {
+    const OpInfo* op = decode_op(opc);
+    return op == NULL || op->isa > chip->mode;
 }
 
 // Execute fetch/decode/execute cycle
@@ -83,7 +280,8 @@ uint8_t cycle(Chip8* chip) {
 
     // Fetch next opcode
     uint16_t opc = (chip->ram[chip->pc] << 8) + chip->ram[chip->pc + 1];
-    chip->pc = (chip->pc + 2) % 0x0ffe;
+    if (chip->trace) trace(chip, opc);
+    chip->pc = (chip->pc + 2) & chip->ram_mask;
 
     // Decode opcode
     uint8_t  xreg = (opc & 0x0f00) >> 8;    // X Register 
@@ -98,186 +296,199 @@ uint8_t cycle(Chip8* chip) {
     switch ( (opc & 0xf000) >> 12) {
     case 0x0:
         if (opc == 0x00e0) {
-            LOG(opc, "cls");
             cls(chip);
         } else if (opc == 0x00ee) {
-            LOG(opc, "ret");
             ret(chip);
+        } else if (isa_missing(chip, opc)) {
+            return 0;
+        } else if ((opc & 0xfff0) == 0x00c0) {
+            scd(chip, nibb);
+        } else if ((opc & 0xfff0) == 0x00d0) {
+            scu(chip, nibb);
+        } else if (opc == 0x00fb) {
+            scr(chip);
+        } else if (opc == 0x00fc) {
+            scl(chip);
+        } else if (opc == 0x00fd) {
+            chip->state = STATE_HALTED;
+        } else if (opc == 0x00fe || opc == 0x00ff) {
+            set_hires(chip, opc == 0x00ff);
         } else {
-            LOG(opc, "UNDEFINED OPCODE");
             return 0;
         }
         break;
     case 0x1:
-        LOG(opc, "jp %d", addr);
         jp(chip, addr);
         break;
     case 0x2:
-        LOG(opc, "call %d", addr);
         call(chip, addr);
         break;
     case 0x3:
-        LOG(opc, "se [v%x]=%d, %d", xreg, xval, ival);
         se(chip, xreg, ival);
         break;
     case 0x4:
-        LOG(opc, "sne [v%x]=%d, %d", xreg, xval, ival);
         sne(chip, xreg, ival);
         break;
     case 0x5:
-        if ((opc & 0xf) != 0) {
-            LOG(opc, "UNDEFINED OPCODE");
+        if ((opc & 0xf) == 0) {
+            se(chip, xreg, yval);
+        } else if (isa_missing(chip, opc)) {
+            return 0;
+        } else if ((opc & 0xf) == 2) {
+            str_range(chip, xreg, yreg);
+        } else if ((opc & 0xf) == 3) {
+            ldr_range(chip, xreg, yreg);
+        } else {
             return 0;
         }
-        LOG(opc, "se [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
-        se(chip, xreg, yval);
         break;
     case 0x6:
-        LOG(opc, "ld [v%x], %d", xreg, ival);
         ld(chip, xreg, ival);
         break;
     case 0x7:
-        LOG(opc, "addnc [v%x]=%d, %d", xreg, xval, ival);
         addnc(chip, xreg, ival);
         break;
     case 0x8: {
         switch (opc & 0xf) {
         case 0:
-            LOG(opc, "ld [v%x], [v%x]=%d", xreg, yreg, yval);
             ld(chip, xreg, yval);
             break;
         case 1:
-            LOG(opc, "or [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             or(chip, xreg, yval);
             break;
         case 2:
-            LOG(opc, "and [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             and(chip, xreg, yval);
             break;
         case 3:
-            LOG(opc, "xor [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             xor(chip, xreg, yval);
             break;
         case 4:
-            LOG(opc, "add [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             add(chip, xreg, yval);
             break;
         case 5:
-            LOG(opc, "sub [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             sub(chip, xreg, yval);
             break;
         case 6:
-            LOG(opc, "shr [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             shr(chip, xreg, yval);
             break;
         case 7:
-            LOG(opc, "subn [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             subn(chip, xreg, yval);
             break;
         case 0xe:
-            LOG(opc, "shl [v%x]=%d, [v%x]=%d", xreg, xval, yreg, yval);
             shl(chip, xreg, yval);
             break;
         default:
-            LOG(opc, "UNDEFINED OPCODE");
             return 0;
         }
         break;
     }
     case 9:
         if ((opc & 0xf) != 0) {
-            LOG(opc, "UNDEFINED OPCODE");
             return 0;
         }
-        LOG(opc, "sne [v%x]=%d, [v%x]=%d", xreg, xval, yreg, ival);
         sne(chip, xreg, yval);
         break;
     case 0xa:
-        LOG(opc, "ldi %d", addr);
         ldi(chip, addr);
         break;
     case 0xb: {
-        uint16_t delta = chip->reg[0];
-        LOG(opc, "jp %d + [v0]=%d = %d", addr, delta, addr + delta);
+        uint16_t delta = chip->reg[chip->quirk_jump ? xreg : 0];
         jp(chip, addr + delta);
         break;
     }
     case 0xc:
-        LOG(opc, "rnd [v%x], %d", xreg, ival);
         rnd(chip, xreg, ival);
         break;
     case 0xd:
-        LOG(opc, "drw [v%x]=%d, [v%x]=%d, %d",xreg,xval,yreg,yval,nibb);
+        if (nibb == 0 && isa_missing(chip, opc)) return 0;
         drw(chip, xreg, yreg, nibb);
         break;
     case 0xe:
         if (ival == 0x9e) {
-            LOG(opc, "skp [v%x]=%d", xreg, xval);
             skp(chip, xval);
         } else if (ival == 0xa1) {
-            LOG(opc, "sknp [v%x]=%d", xreg, xval);
             sknp(chip, xval);
         } else {
-            LOG(opc, "UNDEFINED OPCODE");
             return 0;
         }
         break;
     case 0xf: {
         switch (opc & 0xff) {
+        case 0x00:
+            if (isa_missing(chip, opc)) return 0;
+            ldi_long(chip);
+            break;
+        case 0x01:
+            if (isa_missing(chip, opc)) return 0;
+            plane(chip, xreg);
+            break;
+        case 0x02:
+            if (isa_missing(chip, opc)) return 0;
+            load_pattern(chip);
+            break;
         case 0x07:
-            LOG(opc, "ld [v%x], [delay]=%d", xval, chip->delay);
             ld(chip, xreg, chip->delay);
             break;
         case 0x0a:
             // Check for a key press
-            chip->pc -= 2;
-            LOG(opc, "wait until keypress");
+            chip->pc = (chip->pc - 2) & chip->ram_mask;
+            bool found = false;
             for (uint8_t i = 0; i < 16; i++) {
                 bool keypress = (chip->keypad & (1 << i)) >> i;
                 if (keypress) {
-                    LOG(opc, "ld [v%x], [key]=%d", xreg, i);
+                    observe_key(chip, i);
                     ld(chip, xreg, i);
-                    chip->pc += 2;
+                    chip->pc = (chip->pc + 2) & chip->ram_mask;
+                    found = true;
                     break;
                 }
             }
+            if (chip->metrics != NULL)
+                metrics_key_wait(chip->metrics, chip, found);
             break;
         case 0x15:
-            LOG(opc, "ld [delay], [v%x]=%d", xreg, xval);
             ldd(chip, xval);
             break;
         case 0x18:
-            LOG(opc, "ld [sound], [v%x]=%d", xreg, xval);
             lds(chip, xval);
             break;
         case 0x1e:
-            LOG(opc, "add [i]=%d, [v%x]=%d", chip->i, xreg, xval);
             addi(chip, xval);
             break;
         case 0x29:
-            LOG(opc, "ld sprite [i], [v%x]=%x", xreg, xval);
             ld_sprite(chip, xval);
-            return 0;
+            break;
+        case 0x30:
+            if (isa_missing(chip, opc)) return 0;
+            ld_sprite_big(chip, xval);
+            break;
         case 0x33:
-            LOG(opc, "ld bcd [i], [v%x]=%d", xreg, xval);
             ld_bcd(chip, xval);
             break;
+        case 0x3a:
+            if (isa_missing(chip, opc)) return 0;
+            set_pitch(chip, xval);
+            break;
         case 0x55:
-            LOG(opc, "str [i], [v0] - [v%x]", xreg);
             str(chip, xreg);
             break;
         case 0x65:
-            LOG(opc, "ld [v0] - [v%x], [i]", xreg);
             ldr(chip, xreg);
             break;
+        case 0x75:
+            if (isa_missing(chip, opc)) return 0;
+            save_flags(chip, xreg);
+            break;
+        case 0x85:
+            if (isa_missing(chip, opc)) return 0;
+            load_flags(chip, xreg);
+            break;
         default:
-            LOG(opc, "UNDEFINED OPCODE");
             return 0;
         }
         break;
     }
     default:
-        LOG(opc, "UNDEFINED OPCODE");
         return 0;
     }
 
@@ -285,90 +496,106 @@ uint8_t cycle(Chip8* chip) {
 
 }
 
-// Core execution loop
-void loop(Chip8* chip, ChipState state) {
+// Run one frame worth of cycles, then send clock
+void run_frame(Chip8* chip) {
 
-    init_display();
+    if (chip->state != STATE_RUNNING) return;
 
-    clock_t start = clock();
-    chip->state = state;
-    while (display_is_open()) {
+    long target = (chip->clocks + 1) * chip->cycle_f / chip->clock_f;
+    if (chip->audio != NULL) audio_batch(chip->audio);
+    if (chip->input != NULL) start_input_frame(chip->input, chip, target);
+    while (chip->cycles < target && chip->state == STATE_RUNNING) {
 
-        float delta_t = (clock() - start) / (float)CLOCKS_PER_SEC;
-        chip->keypad = get_keypad_inputs();
-
-        switch (chip->state) {
-        case STATE_RUNNING: {
-            if (chip->cycles <= delta_t * chip->cycle_f) {
-                cycle(chip);
-                chip->cycles++;
-            }
+        // Key events land at their place in the frame
+        if (chip->input != NULL && chip->cycles >= chip->input->due)
+            apply_input(chip->input, chip);
 
-            if (chip->clocks <= delta_t * chip->clock_f) {
-                send_clock(chip);
-                update_display(chip);
-                chip->clocks++;
-            }
-            break;
-        }
-        case STATE_STEPPING: {
-            // Update display and clock at 60fps
-            if (chip->clocks <= delta_t * chip->clock_f) {
-
-                // Step forward when space is pressed
-                if (is_space_pressed()) {
-                    cycle(chip);
-                    chip->cycles++;
-                }
-                send_clock(chip);
-                update_display(chip);
-                chip->clocks++;
-            }
-            break;
-        }
-        case STATE_HALTED:
-            // Update display at 60fps
-            if (chip->clocks <= delta_t * chip->clock_f) {
-                update_display(chip);
-            }
+        // A draw ends the batch, the rest of the frame is yielded
+        if (chip->vblank_wait) {
+            chip->yielded += target - chip->cycles;
+            chip->frame_yield += target - chip->cycles;
+            chip->cycles = target;
             break;
         }
 
-        // Each Frame, check for state changes from pressing p, s, r
-        if (is_p_pressed()) {
-            chip->state = STATE_HALTED;
-        }
-        if (is_space_pressed()) {
-            if (chip->state != STATE_STEPPING) {
-                chip->cycles = 0;
-                chip->clocks = 0;
-                start = clock();
-            }
-            chip->state = STATE_STEPPING;
-        }
-        if (is_enter_pressed()) {
-            if (chip->state != STATE_RUNNING) {
-                chip->cycles = 0;
-                chip->clocks = 0;
-                start = clock();
-            }
-            chip->state = STATE_RUNNING;
+        // Recompiled code runs until it leaves what it knows about. It
+        // doesn't count cycles as it goes, which audio edges need, and
+        // stops short of the next key event
+        if (chip->aot != NULL && chip->exec == cycle && chip->audio == NULL) {
+            long budget = target - chip->cycles;
+            if (chip->input != NULL && chip->input->due - chip->cycles < budget)
+                budget = chip->input->due - chip->cycles;
+            long n = chip->aot(chip, budget);
+            chip->cycles += n;
+            chip->frame_exec += n;
+            if (n >= budget || chip->vblank_wait) continue;
         }
-    }
 
-    end_display();
-    printf("fin.\n");
+        chip->exec(chip);
+        chip->cycles++;
+        chip->frame_exec++;
+    }
 
+    // A breakpoint stops the frame before the clock. Events at the very end
+    // of the frame, or skipped by the vblank yield, are applied before it
+    if (chip->state != STATE_RUNNING) return;
+    if (chip->input != NULL) apply_input(chip->input, chip);
+    send_clock(chip);
+    chip->clocks++;
 }
 
-// Run loop
-void run(Chip8* chip) {
-    loop(chip, STATE_RUNNING);
+// Sleep until deadline on the monotonic clock
+static void sleep_until(const struct timespec* deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ns = (deadline->tv_sec - now.tv_sec) * 1000000000L
+            + (deadline->tv_nsec - now.tv_nsec);
+    if (ns <= 0) return;
+    struct timespec d = {ns / 1000000000L, ns % 1000000000L};
+    nanosleep(&d, NULL);
 }
 
-// Step through loop
-void step(Chip8* chip) {
-    loop(chip, STATE_STEPPING);
+// Run without a window for a number of frames, or forever if 0
+void run_headless(Chip8* chip, long frames) {
+
+    long period = 1000000000L / chip->clock_f;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    chip->state = STATE_RUNNING;
+    long done = 0;
+    while (frames == 0 || done < frames) {
+
+        // A client holding the chip halted is waited on, not spun on
+        if (chip->server != NULL) {
+            if (chip->state == STATE_HALTED) {
+                wait_debug_server(chip->server, SERVER_WAIT_MS);
+                clock_gettime(CLOCK_MONOTONIC, &next);
+            }
+            poll_debug_server(chip->server, chip);
+            if (chip->server->killed) break;
+        }
+
+        // Without a client nothing resumes a halted chip, the program ended
+        if (chip->state == STATE_HALTED && chip->server == NULL) break;
+
+        // Only frames that reached the clock count
+        long clocks = chip->clocks;
+        run_frame(chip);
+        done += chip->clocks - clocks;
+        if (chip->clocks == clocks) continue;
+
+        // Hold real time pace unless running as fast as possible
+        if (chip->throttle) {
+            next.tv_nsec += period;
+            next.tv_sec += next.tv_nsec / 1000000000L;
+            next.tv_nsec %= 1000000000L;
+            sleep_until(&next);
+        }
+    }
+
+    printf("%ld frames: %ld cycles executed, %ld yielded to vblank\n",
+           chip->clocks, chip->cycles - chip->yielded, chip->yielded);
 }
 
 // Dump VM State
@@ -413,10 +640,12 @@ void dump_ram(Chip8* chip) {
 // Dump video memory
 void dump_video_memory(Chip8* chip) {
 
-    for (int y = 0; y < VID_HEIGHT; y++) {
-        for (int x = 0; x < VID_WIDTH; x++) {
-            if (chip->vid[y*VID_WIDTH + x] == 1) printf("X");
-            else printf(".");
+    int width = chip->vid.hires ? HIRES_WIDTH : VID_WIDTH;
+    int height = chip->vid.hires ? HIRES_HEIGHT : VID_HEIGHT;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int s = chip->vid.hires ? 1 : 2;
+            printf("%c", ".X+#"[get_pixel(&chip->vid, x * s, y * s)]);
         }
         printf("\n");
     }
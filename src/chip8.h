@@ -7,8 +7,27 @@
 
 #define VID_WIDTH (64)
 #define VID_HEIGHT (32)
+#define HIRES_WIDTH (128)
+#define HIRES_HEIGHT (64)
+#define VID_PLANES (2)
 #define RESET_VECTOR (0x200)
 #define FONT_VECTOR (0x50)
+#define BIG_FONT_VECTOR (0xa0)
+
+// Output resolution, low resolution pixels are doubled
+#define SCREEN_WIDTH (HIRES_WIDTH)
+#define SCREEN_HEIGHT (HIRES_HEIGHT)
+
+// Memory model: addresses wrap with ram_mask, which is RAM_MASK, or
+// XO_RAM_MASK for XO-CHIP. Guard bytes past the end mirror low memory, so a
+// sprite or register block starting at any masked address can be read
+// without wrapping each byte
+#define RAM_SIZE (0x1000)
+#define RAM_MASK (RAM_SIZE - 1)
+#define XO_RAM_SIZE (0x10000)
+#define XO_RAM_MASK (XO_RAM_SIZE - 1)
+#define RAM_GUARD (0x40)
+#define STACK_MASK (0xf)
 
 typedef enum {
     STATE_HALTED,
@@ -16,6 +35,33 @@ typedef enum {
     STATE_STEPPING,
 } ChipState;
 
+typedef enum {
+    MODE_CHIP8,             // Original CHIP-8, 4K
+    MODE_SCHIP,             // SUPER-CHIP 1.1, 4K
+    MODE_XOCHIP,            // XO-CHIP, 64K and two planes
+} ChipMode;
+
+// One row of pixels, column 0 in the top bit. Low resolution uses the top
+// 64 bits of rows 0-31
+__extension__ typedef unsigned __int128 Row;
+
+typedef struct Frame {
+    Row rows[VID_PLANES][HIRES_HEIGHT]; // Bitplanes
+    bool hires;                         // 128x64 mode
+} Frame;
+
+// Plane bits of pixel at x, y of the SCREEN_WIDTH x SCREEN_HEIGHT output
+static inline uint8_t get_pixel(const Frame* f, int x, int y) {
+    if (!f->hires) {
+        x >>= 1;
+        y >>= 1;
+    }
+    uint8_t p = 0;
+    for (int pl = 0; pl < VID_PLANES; pl++)
+        p |= ((f->rows[pl][y] >> (127 - x)) & 1) << pl;
+    return p;
+}
+
 typedef struct Chip8 {
 
     // Registers
@@ -28,12 +74,22 @@ typedef struct Chip8 {
     uint8_t delay;          // Delay Timer
     uint8_t sound;          // Timer Register
     uint16_t keypad;        // Keypress Register
+    uint32_t rng;           // Random number generator state
     
     // Memory
-    uint8_t ram[0xfff];     // Ram
-    uint8_t vid[VID_WIDTH * VID_HEIGHT]; // Video memory
+    uint8_t ram[XO_RAM_SIZE + RAM_GUARD]; // Ram, mirror of 0x000-0x03f after
+    uint16_t ram_mask;      // RAM_MASK or XO_RAM_MASK
+    Frame vid;              // Video memory
+    uint8_t planes;         // Planes drawn to, XO-CHIP
+    uint8_t rpl[16];        // SUPER-CHIP flag registers
+    uint8_t pattern[16];    // XO-CHIP audio pattern, 1 bit samples
+    uint8_t pitch;          // XO-CHIP pattern playback pitch
+    bool hashing;           // Keep hashes current, for frame tables
+    uint64_t hash;          // Incremental hash of reg and ram
+    uint64_t vid_hash[VID_PLANES]; // Incremental hash of each plane
 
     // Quirks
+    ChipMode mode;          // Instruction set and memory size
     bool quirk_vf_reset;    // Flag Reset Quirk
     bool quirk_memory;      // Memory Quirk
     bool quirk_disp_wait;   // Wait for display vsync quirk
@@ -46,20 +102,60 @@ typedef struct Chip8 {
     float cycle_f;          // Cycle Frequency
     long cycles;            // Number of cycles executed
     long clocks;            // Number of clock pulses sent
+    bool throttle;          // Pace headless runs to clock frequency
+    long yielded;           // Cycles skipped waiting for vblank
+    long frame_exec;        // Cycles executed so far this frame
+    long frame_yield;       // Cycles yielded so far this frame
+    long last_exec;         // Cycles executed in last complete frame
+    long last_yield;        // Cycles yielded in last complete frame
 
     // State
     ChipState state;        // Chip State
+    bool trace;             // Print each executed instruction
+    bool vblank_wait;       // Drew with disp_wait quirk, idle until clock
+    bool debug_ui;          // Window can show debug and RAM panels
+
+    // Debugging
+    struct Analysis* analysis; // Static analysis of loaded rom, if any
+    struct Debugger* debug;    // Breakpoints and watchpoints, if any
+    uint8_t (*exec)(struct Chip8* chip); // Cycle function for running state
+    struct DebugServer* server; // Remote debug server, if any
+
+    // Recompiled code, returns instructions run, stops at untranslated code
+    long (*aot)(struct Chip8* chip, long budget);
+    const uint8_t* aot_code;    // Translated bytes, a write to one drops aot
+
+    // Output
+    struct Capture* capture;    // Video capture, if any
+    struct StreamServer* stream; // Spectator stream, if any
+    struct Audio* audio;        // Sound output, if any
+    struct Metrics* metrics;    // Runtime counters export, if any
+
+    // Input
+    struct Input* input;        // Key event queue, if any
 
 } Chip8;
 
+struct AotModule;
+
 void init_chip8(Chip8* chip);                   // Initialize VM
 void load_rom(Chip8* chip, const char* path);   // Load rom into memory
+void set_mode(Chip8* chip, ChipMode mode);      // Select mode and quirks
+void mirror_guard(Chip8* chip);                 // Refresh RAM guard bytes
+void attach_analysis(Chip8* chip, const char* path); // Load rom analysis
+bool attach_aot(Chip8* chip, const struct AotModule* mod); // Use AOT code
+void invalidate_aot(Chip8* chip, uint16_t addr, unsigned len); // Code written
 
 void dump_state(Chip8* chip);                   // Dump VM State
 void dump_ram(Chip8* chip);                     // Dump RAM
 void dump_display(Chip8* chip);                 // Draw Display in ASCII
 
+uint8_t cycle(Chip8* chip);                     // Execute one instruction
 void run(Chip8* chip);                          // Run VM indefinitely
+void run_frame(Chip8* chip);                    // Run one frame of cycles
+void send_clock(Chip8* chip);                   // 60Hz timer tick
+void end_frame(Chip8* chip);                    // Count and publish frame
+void run_headless(Chip8* chip, long frames);    // Run VM without a window
 void step(Chip8* chip);                         // Step through cycles
 
 #endif  // CHIP8_H
@@ -0,0 +1,249 @@
+#include <stdlib.h>
+#include <assert.h>
+
+#include "debug.h"
+
+// Get debugger state, allocating it on first use
+static Debugger* get_debugger(Chip8* chip) {
+    if (chip->debug == NULL) {
+        chip->debug = calloc(1, sizeof(Debugger));
+        assert(chip->debug != NULL && "Unable to allocate debugger!");
+        chip->debug->stopped_at = NO_ADDR;
+    }
+    return chip->debug;
+}
+
+// Test address in bit map
+static inline bool map_test(const uint8_t* map, uint16_t addr) {
+    return map[addr / 8] >> (addr % 8) & 1;
+}
+
+// Set address in bit map
+static inline void map_set(uint8_t* map, uint16_t addr) {
+    map[addr / 8] |= 1 << addr % 8;
+}
+
+// Clear address in bit map
+static inline void map_clear(uint8_t* map, uint16_t addr) {
+    map[addr / 8] &= ~(1 << addr % 8);
+}
+
+// Only pay for breakpoint checks while any are set
+static void update_dispatch(Chip8* chip) {
+    Debugger* dbg = chip->debug;
+    bool active = dbg->nbreaks > 0 || dbg->nwatch > 0 || dbg->ncond > 0
+                  || dbg->checked;
+    chip->exec = active ? cycle_debug : cycle;
+}
+
+// Set breakpoint at address, or clear it if already set
+void toggle_breakpoint(Chip8* chip, uint16_t addr) {
+    Debugger* dbg = get_debugger(chip);
+    addr &= BREAK_MAP_SIZE - 1;
+
+    if (map_test(dbg->breaks, addr)) {
+        map_clear(dbg->breaks, addr);
+        if (!map_test(dbg->conds, addr)) dbg->nbreaks--;
+    } else {
+        if (!map_test(dbg->conds, addr)) dbg->nbreaks++;
+        map_set(dbg->breaks, addr);
+    }
+    update_dispatch(chip);
+}
+
+// Return true if an unconditional breakpoint is set at address
+bool has_breakpoint(Chip8* chip, uint16_t addr) {
+    if (chip->debug == NULL) return false;
+    return map_test(chip->debug->breaks, addr & (BREAK_MAP_SIZE - 1));
+}
+
+// Watch memory range for reads and/or writes
+bool add_watchpoint(Chip8* chip, uint16_t addr, uint16_t len, uint8_t kind) {
+    Debugger* dbg = get_debugger(chip);
+    if (dbg->nwatch == MAX_WATCHPOINTS) return false;
+
+    dbg->watch[dbg->nwatch++] = (Watchpoint){addr, len, kind};
+    update_dispatch(chip);
+    return true;
+}
+
+// Remove watchpoint matching range and kind
+bool remove_watchpoint(Chip8* chip, uint16_t addr, uint16_t len, uint8_t kind) {
+    Debugger* dbg = chip->debug;
+    if (dbg == NULL) return false;
+    for (uint8_t w = 0; w < dbg->nwatch; w++) {
+        Watchpoint* wp = &dbg->watch[w];
+        if (wp->addr == addr && wp->len == len && wp->kind == kind) {
+            *wp = dbg->watch[--dbg->nwatch];
+            update_dispatch(chip);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Break at address when register holds value
+bool add_condition(Chip8* chip, uint16_t addr, uint8_t reg, uint8_t val) {
+    Debugger* dbg = get_debugger(chip);
+    if (dbg->ncond == MAX_CONDITIONS) return false;
+
+    addr &= BREAK_MAP_SIZE - 1;
+    dbg->cond[dbg->ncond++] = (Condition){addr, reg & 0xf, val};
+    if (!map_test(dbg->breaks, addr) && !map_test(dbg->conds, addr))
+        dbg->nbreaks++;
+    map_set(dbg->conds, addr);
+    update_dispatch(chip);
+    return true;
+}
+
+// Report accesses that rely on address wrapping or stack over/underflow
+void set_checked(Chip8* chip, bool checked) {
+    Debugger* dbg = get_debugger(chip);
+    dbg->checked = checked;
+    update_dispatch(chip);
+}
+
+// Remove all breakpoints, watchpoints and conditions
+void clear_debug(Chip8* chip) {
+    if (chip->debug == NULL) return;
+    free(chip->debug);
+    chip->debug = NULL;
+    chip->exec = cycle;
+}
+
+// Let the next instruction run even if it has a breakpoint, for resuming
+void skip_breakpoint(Chip8* chip) {
+    if (chip->debug != NULL) chip->debug->stopped_at = chip->pc;
+}
+
+// Find memory range accessed by opcode from i, returns access kind or 0
+static uint8_t mem_access(const Chip8* chip, uint16_t opc, uint16_t* len) {
+    uint8_t x = (opc & 0x0f00) >> 8;
+    uint8_t y = (opc & 0x00f0) >> 4;
+    switch (opc & 0xf0ff) {
+    case 0xf055: *len = x + 1; return WATCH_WRITE;
+    case 0xf033: *len = 3;     return WATCH_WRITE;
+    case 0xf065: *len = x + 1; return WATCH_READ;
+    }
+    if (opc == 0xf002 && chip->mode == MODE_XOCHIP) {
+        *len = 16;
+        return WATCH_READ;
+    }
+
+    // XO-CHIP register range stores and loads, in either direction
+    if ((opc & 0xf00e) == 0x5002 && chip->mode == MODE_XOCHIP) {
+        *len = (x > y ? x - y : y - x) + 1;
+        return (opc & 0xf) == 2 ? WATCH_WRITE : WATCH_READ;
+    }
+
+    // Each selected plane reads the next sprite, 16x16 sprites are 32 bytes
+    if ((opc & 0xf000) == 0xd000) {
+        int planes = (chip->planes & 1) + ((chip->planes >> 1) & 1);
+        int n = opc & 0xf;
+        if (n == 0 && chip->mode != MODE_CHIP8) n = 32;
+        *len = n * planes;
+        return *len ? WATCH_READ : 0;
+    }
+    return 0;
+}
+
+// True if access of len bytes from i touches watched range, accesses past
+// the end of memory wrap to the start
+static bool overlaps(const Watchpoint* wp, uint32_t i, uint32_t len,
+                     uint32_t size) {
+    return (i < wp->addr + wp->len && wp->addr < i + len)
+        || (i + len > size && wp->addr < i + len - size);
+}
+
+// Check breakpoints, conditions and watchpoints for next instruction
+static bool should_break(Chip8* chip, Debugger* dbg) {
+
+    uint16_t pc = chip->pc;
+
+    if (map_test(dbg->breaks, pc & (BREAK_MAP_SIZE - 1))) {
+        printf("break: breakpoint at %03x\n", pc);
+        return true;
+    }
+
+    if (map_test(dbg->conds, pc & (BREAK_MAP_SIZE - 1))) {
+        for (uint8_t c = 0; c < dbg->ncond; c++) {
+            Condition* cond = &dbg->cond[c];
+            if (cond->addr == pc && chip->reg[cond->reg] == cond->val) {
+                printf("break: [v%x]=%d at %03x\n", cond->reg, cond->val, pc);
+                return true;
+            }
+        }
+    }
+
+    if (dbg->nwatch > 0) {
+        uint16_t opc = (chip->ram[pc] << 8) + chip->ram[pc + 1];
+        uint16_t len = 0;
+        uint8_t kind = mem_access(chip, opc, &len);
+        uint16_t i = chip->i & chip->ram_mask;
+        for (uint8_t w = 0; kind && w < dbg->nwatch; w++) {
+            Watchpoint* wp = &dbg->watch[w];
+            if ((wp->kind & kind)
+                && overlaps(wp, i, len, chip->ram_mask + 1)) {
+                printf("break: %s of %03x-%03x at %03x\n",
+                       kind == WATCH_WRITE ? "write" : "read",
+                       i, (i + len - 1) & chip->ram_mask, pc);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+// Report next instruction if it wraps memory or the stack, once per address
+static void check_model(Chip8* chip, Debugger* dbg) {
+
+    uint16_t pc = chip->pc;
+    uint16_t opc = (chip->ram[pc] << 8) + chip->ram[pc + 1];
+    uint16_t len = 0;
+    const char* what = NULL;
+    char text[64];
+
+    // The jumping quirk makes Bnnn add vX instead of v0
+    uint8_t jump_reg = chip->quirk_jump ? (opc & 0x0f00) >> 8 : 0;
+
+    if (pc == chip->ram_mask) {
+        what = "fetch wraps past end";
+    } else if (opc == 0x00ee && chip->sp == 0) {
+        what = "stack underflow";
+    } else if ((opc & 0xf000) == 0x2000 && chip->sp == STACK_MASK) {
+        what = "stack overflow";
+    } else if ((opc & 0xf000) == 0xb000
+               && (opc & 0x0fff) + chip->reg[jump_reg] > chip->ram_mask) {
+        what = "jump wraps past end";
+    } else if (mem_access(chip, opc, &len)
+               && chip->i + len > chip->ram_mask + 1) {
+        snprintf(text, sizeof(text), "access of %03x-%03x wraps past end",
+                 chip->i, chip->i + len - 1);
+        what = text;
+    }
+    if (what == NULL) return;
+
+    dbg->violations++;
+    uint16_t bit = pc & (BREAK_MAP_SIZE - 1);
+    if (map_test(dbg->reported, bit)) return;
+    map_set(dbg->reported, bit);
+    printf("check: %s at %03x\n", what, pc);
+}
+
+// Execute cycle, halting first if the instruction hits a breakpoint
+uint8_t cycle_debug(Chip8* chip) {
+
+    Debugger* dbg = chip->debug;
+    if (dbg->checked) check_model(chip, dbg);
+
+    // Don't break again on the instruction we stopped at when resuming
+    if (chip->pc != dbg->stopped_at && should_break(chip, dbg)) {
+        dbg->stopped_at = chip->pc;
+        chip->state = STATE_HALTED;
+        return 0;
+    }
+
+    dbg->stopped_at = NO_ADDR;
+    return cycle(chip);
+}
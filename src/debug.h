@@ -0,0 +1,53 @@
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include "chip8.h"
+
+#define BREAK_MAP_SIZE  (XO_RAM_SIZE)  // Whole XO-CHIP address space, bits
+#define MAX_WATCHPOINTS (16)
+#define MAX_CONDITIONS  (16)
+#define NO_ADDR         (0xffff)
+
+// Watchpoint kinds
+#define WATCH_READ      (1 << 0)    // Reads by ldr, 5xy3, F002 and drw sprite
+                                    // fetches
+#define WATCH_WRITE     (1 << 1)    // Writes by str, 5xy2 and ld_bcd
+
+typedef struct Watchpoint {
+    uint16_t addr;          // First watched address
+    uint16_t len;           // Number of watched bytes
+    uint8_t kind;           // Accesses to watch for
+} Watchpoint;
+
+typedef struct Condition {
+    uint16_t addr;          // Address of conditional breakpoint
+    uint8_t reg;            // Register to test
+    uint8_t val;            // Break if register holds this value
+} Condition;
+
+typedef struct Debugger {
+    uint8_t breaks[BREAK_MAP_SIZE / 8]; // Addresses to break at
+    uint8_t conds[BREAK_MAP_SIZE / 8];  // Addresses with conditions
+    uint16_t nbreaks;                   // Number of addresses in either map
+    Watchpoint watch[MAX_WATCHPOINTS];  // Memory watchpoints
+    uint8_t nwatch;                     // Number of watchpoints
+    Condition cond[MAX_CONDITIONS];     // Conditional breakpoints
+    uint8_t ncond;                      // Number of conditions
+    uint16_t stopped_at;                // Address we last stopped at
+    bool checked;                       // Report memory model violations
+    long violations;                    // Number of violations found
+    uint8_t reported[BREAK_MAP_SIZE / 8]; // Addresses already reported
+} Debugger;
+
+void toggle_breakpoint(Chip8* chip, uint16_t addr);
+bool has_breakpoint(Chip8* chip, uint16_t addr);
+bool add_watchpoint(Chip8* chip, uint16_t addr, uint16_t len, uint8_t kind);
+bool remove_watchpoint(Chip8* chip, uint16_t addr, uint16_t len, uint8_t kind);
+bool add_condition(Chip8* chip, uint16_t addr, uint8_t reg, uint8_t val);
+void set_checked(Chip8* chip, bool checked);
+void clear_debug(Chip8* chip);
+void skip_breakpoint(Chip8* chip);
+
+uint8_t cycle_debug(Chip8* chip);   // Cycle with breakpoint and model checks
+
+#endif  // DEBUG_H
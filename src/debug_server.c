@@ -0,0 +1,360 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "debug_server.h"
+#include "debug.h"
+#include "net.h"
+#include "hash.h"
+
+// Listen on localhost TCP port, or unix domain socket for "unix:<path>"
+DebugServer* open_debug_server(const char* addr) {
+
+    int fd = listen_socket(addr, 1);
+    if (fd < 0) return NULL;
+
+    DebugServer* srv = calloc(1, sizeof(DebugServer));
+    srv->listen_fd = fd;
+    srv->client_fd = -1;
+    return srv;
+}
+
+// Drop attached client
+static void detach(DebugServer* srv) {
+    if (srv->client_fd >= 0) close(srv->client_fd);
+    srv->client_fd = -1;
+    srv->in_len = 0;
+    srv->out_len = 0;
+    srv->waiting = false;
+}
+
+// Close server and attached client
+void close_debug_server(DebugServer* srv) {
+    detach(srv);
+    close(srv->listen_fd);
+    free(srv);
+}
+
+// Send as much queued output as the socket takes without blocking
+static void flush(DebugServer* srv) {
+    int sent = 0;
+    while (sent < srv->out_len) {
+        ssize_t n = send(srv->client_fd, srv->out + sent, srv->out_len - sent,
+                         MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n <= 0) break;
+        sent += n;
+    }
+    memmove(srv->out, srv->out + sent, srv->out_len - sent);
+    srv->out_len -= sent;
+}
+
+// Queue packet with framing and checksum
+static void reply(DebugServer* srv, const char* data) {
+    int len = strlen(data);
+    if (srv->out_len + len + 4 > (int)sizeof(srv->out)) {
+        detach(srv);    // Client stopped reading
+        return;
+    }
+
+    uint8_t sum = 0;
+    for (int i = 0; i < len; i++) sum += data[i];
+    srv->out_len += snprintf(srv->out + srv->out_len,
+                             sizeof(srv->out) - srv->out_len,
+                             "$%s#%02x", data, sum);
+}
+
+// Parse hex number, advancing pointer
+static unsigned long parse_hex(const char** p) {
+    char* end;
+    unsigned long v = strtoul(*p, &end, 16);
+    *p = end;
+    return v;
+}
+
+// Parse hex byte pair
+static uint8_t hex_byte(const char* p) {
+    char b[3] = {p[0], p[1], 0};
+    return strtoul(b, NULL, 16);
+}
+
+// True if p starts with n hex digits
+static bool has_hex(const char* p, size_t n) {
+    for (size_t k = 0; k < n; k++)
+        if (!isxdigit((unsigned char)p[k])) return false;
+    return true;
+}
+
+// Hex digits of register in g/G/p/P packets
+static int reg_digits(unsigned n) {
+    return n == SREG_I || n == SREG_PC ? 4 : 2;
+}
+
+// Read register by number, 16bit registers are little endian
+static int read_reg(Chip8* chip, unsigned n, char* buf) {
+    switch (n) {
+    case SREG_I:     return sprintf(buf, "%02x%02x", chip->i & 0xff,
+                                    chip->i >> 8);
+    case SREG_PC:    return sprintf(buf, "%02x%02x", chip->pc & 0xff,
+                                    chip->pc >> 8);
+    case SREG_SP:    return sprintf(buf, "%02x", chip->sp);
+    case SREG_DELAY: return sprintf(buf, "%02x", chip->delay);
+    case SREG_SOUND: return sprintf(buf, "%02x", chip->sound);
+    default:         return sprintf(buf, "%02x", chip->reg[n & 0xf]);
+    }
+}
+
+// Write register by number from reg_digits() hex digits, returns number of
+// hex digits consumed
+static int write_reg(Chip8* chip, unsigned n, const char* hex) {
+    switch (n) {
+    case SREG_I:
+        chip->i = hex_byte(hex) | hex_byte(hex + 2) << 8;
+        return 4;
+    case SREG_PC:
+        chip->pc = (hex_byte(hex) | hex_byte(hex + 2) << 8) & chip->ram_mask;
+        return 4;
+    case SREG_SP:    chip->sp = hex_byte(hex) & STACK_MASK; return 2;
+    case SREG_DELAY: chip->delay = hex_byte(hex);      return 2;
+    case SREG_SOUND: chip->sound = hex_byte(hex);      return 2;
+    default: {
+        // Keep the state hash current, as set_reg() does
+        uint8_t r = n & 0xf;
+        uint8_t val = hex_byte(hex);
+        if (chip->hashing)
+            chip->hash ^= hash_byte(HASH_REG + r, chip->reg[r])
+                        ^ hash_byte(HASH_REG + r, val);
+        chip->reg[r] = val;
+        return 2;
+    }
+    }
+}
+
+// Set or clear breakpoint/watchpoint from Z/z packet
+static bool set_point(Chip8* chip, const char* p, bool insert) {
+    unsigned type = parse_hex(&p);
+    if (*p++ != ',') return false;
+    uint16_t addr = parse_hex(&p);
+    if (*p++ != ',') return false;
+    uint16_t len = parse_hex(&p);
+
+    switch (type) {
+    case 0:     // Software breakpoint
+    case 1:     // Hardware breakpoint
+        if (has_breakpoint(chip, addr) != insert)
+            toggle_breakpoint(chip, addr);
+        return true;
+    case 2:     // Write watchpoint
+    case 3:     // Read watchpoint
+    case 4: {   // Access watchpoint
+        uint8_t kind = type == 2 ? WATCH_WRITE
+                     : type == 3 ? WATCH_READ : WATCH_READ | WATCH_WRITE;
+        if (insert) return add_watchpoint(chip, addr, len, kind);
+        return remove_watchpoint(chip, addr, len, kind);
+    }
+    }
+    return false;
+}
+
+// Handle one packet body
+static void handle_packet(DebugServer* srv, Chip8* chip, const char* p) {
+
+    static char buf[SERVER_BUF_SIZE];
+
+    switch (*p++) {
+    case '?':
+        reply(srv, "S05");
+        break;
+    case 'g': {
+        int n = 0;
+        for (unsigned r = 0; r < SREG_COUNT; r++) n += read_reg(chip, r, buf + n);
+        reply(srv, buf);
+        break;
+    }
+    case 'G': {
+        // All registers or none
+        size_t n = 0;
+        for (unsigned r = 0; r < SREG_COUNT; r++) n += reg_digits(r);
+        if (!has_hex(p, n)) { reply(srv, "E01"); break; }
+        for (unsigned r = 0; r < SREG_COUNT; r++) p += write_reg(chip, r, p);
+        reply(srv, "OK");
+        break;
+    }
+    case 'p': {
+        unsigned r = parse_hex(&p);
+        if (r >= SREG_COUNT) { reply(srv, "E01"); break; }
+        read_reg(chip, r, buf);
+        reply(srv, buf);
+        break;
+    }
+    case 'P': {
+        unsigned r = parse_hex(&p);
+        if (r >= SREG_COUNT || *p++ != '=' || !has_hex(p, reg_digits(r))) {
+            reply(srv, "E01");
+            break;
+        }
+        write_reg(chip, r, p);
+        reply(srv, "OK");
+        break;
+    }
+    case 'm': {
+        unsigned addr = parse_hex(&p);
+        unsigned len = *p == ',' ? (p++, parse_hex(&p)) : 0;
+        if (len * 2 >= sizeof(buf)) len = sizeof(buf) / 2 - 1;
+        for (unsigned a = 0; a < len; a++)
+            sprintf(buf + a * 2, "%02x", chip->ram[(addr + a) & chip->ram_mask]);
+        buf[len * 2] = '\0';
+        reply(srv, buf);
+        break;
+    }
+    case 'M': {
+        unsigned addr = parse_hex(&p);
+        unsigned len = *p == ',' ? (p++, parse_hex(&p)) : 0;
+        if (*p++ != ':' || !has_hex(p, len * 2)) { reply(srv, "E01"); break; }
+        for (unsigned a = 0; a < len; a++, p += 2) {
+            uint16_t m = (addr + a) & chip->ram_mask;
+            uint8_t val = hex_byte(p);
+            if (chip->hashing)
+                chip->hash ^= hash_byte(HASH_RAM + m, chip->ram[m])
+                            ^ hash_byte(HASH_RAM + m, val);
+            chip->ram[m] = val;
+        }
+        mirror_guard(chip);
+        invalidate_aot(chip, addr, len);
+        reply(srv, "OK");
+        break;
+    }
+    case 's':
+        cycle(chip);
+        chip->cycles++;
+        reply(srv, "S05");
+        break;
+    case 'c':
+        skip_breakpoint(chip);
+        chip->state = STATE_RUNNING;
+        srv->waiting = true;
+        break;
+    case 'Z':
+    case 'z':
+        reply(srv, set_point(chip, p, p[-1] == 'Z') ? "OK" : "E01");
+        break;
+    case 'q':
+        if (strncmp(p, "Supported", 9) == 0) {
+            char size[32];
+            snprintf(size, sizeof(size), "PacketSize=%x", SERVER_PACKET_SIZE);
+            reply(srv, size);
+        } else if (strcmp(p, "Attached") == 0) reply(srv, "1");
+        else if (strcmp(p, "C") == 0) reply(srv, "QC1");
+        else reply(srv, "");
+        break;
+    case 'H':
+        reply(srv, "OK");
+        break;
+    case 'D':
+        reply(srv, "OK");
+        flush(srv);
+        detach(srv);
+        chip->state = STATE_RUNNING;
+        break;
+    case 'k':
+        // Kill ends emulation, the run loops return
+        detach(srv);
+        chip->state = STATE_HALTED;
+        srv->killed = true;
+        break;
+    default:
+        reply(srv, "");     // Unsupported
+        break;
+    }
+}
+
+// Split received bytes into packets and handle a bounded number of them
+static void handle_input(DebugServer* srv, Chip8* chip) {
+
+    int pos = 0;
+    int handled = 0;
+    while (pos < srv->in_len && handled < SERVER_MAX_PACKETS) {
+        char c = srv->in[pos];
+
+        if (c == 0x03) {
+            // Interrupt
+            chip->state = STATE_HALTED;
+            pos++;
+            continue;
+        }
+        if (c != '$') {
+            pos++;          // Acks and line noise
+            continue;
+        }
+
+        char* hash = memchr(srv->in + pos, '#', srv->in_len - pos);
+        if (hash == NULL || hash + 2 >= srv->in + srv->in_len) break;
+
+        // Corrupted packets are nacked, the client sends them again
+        char* body = srv->in + pos + 1;
+        uint8_t sum = 0;
+        for (char* b = body; b < hash; b++) sum += *b;
+        bool ok = has_hex(hash + 1, 2) && hex_byte(hash + 1) == sum;
+        if (srv->out_len < (int)sizeof(srv->out))
+            srv->out[srv->out_len++] = ok ? '+' : '-';
+        pos = hash + 3 - srv->in;
+        if (!ok) continue;
+
+        *hash = '\0';
+        handle_packet(srv, chip, body);
+        if (srv->client_fd < 0) return;
+        handled++;
+    }
+
+    memmove(srv->in, srv->in + pos, srv->in_len - pos);
+    srv->in_len -= pos;
+}
+
+// Service client, called once per frame so the idle cost is one syscall
+void poll_debug_server(DebugServer* srv, Chip8* chip) {
+
+    if (srv->client_fd < 0) {
+        int fd = accept(srv->listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        if (!set_nonblocking(fd)) {
+            close(fd);
+            return;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        srv->client_fd = fd;
+        chip->state = STATE_HALTED;     // Stop on attach, like gdbserver
+    }
+
+    ssize_t n = recv(srv->client_fd, srv->in + srv->in_len,
+                     sizeof(srv->in) - srv->in_len - 1, MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        detach(srv);
+        return;
+    }
+    if (n > 0) srv->in_len += n;
+
+    handle_input(srv, chip);
+    if (srv->client_fd < 0) return;
+
+    // Report when a breakpoint or interrupt stops a continue
+    if (srv->waiting && chip->state == STATE_HALTED) {
+        srv->waiting = false;
+        reply(srv, "S05");
+    }
+
+    flush(srv);
+}
+
+// Block until the client sends something, or one connects, for up to ms.
+// For callers with nothing to run while the client holds the chip halted
+void wait_debug_server(DebugServer* srv, int ms) {
+    struct pollfd p = {srv->client_fd >= 0 ? srv->client_fd : srv->listen_fd,
+                       POLLIN, 0};
+    poll(&p, 1, ms);
+}
@@ -0,0 +1,36 @@
+#ifndef DEBUG_SERVER_H
+#define DEBUG_SERVER_H
+
+#include "chip8.h"
+
+#define SERVER_BUF_SIZE     (0x4000)
+#define SERVER_PACKET_SIZE  (SERVER_BUF_SIZE - 8) // Advertised, leaves room for
+                                                  // $, #xx, an ack and a nul
+#define SERVER_MAX_PACKETS  (16)        // Packets handled per frame
+#define SERVER_WAIT_MS      (100)       // Longest wait for a halting client
+
+// Register numbers for p/P packets
+#define SREG_I      (16)
+#define SREG_PC     (17)
+#define SREG_SP     (18)
+#define SREG_DELAY  (19)
+#define SREG_SOUND  (20)
+#define SREG_COUNT  (21)
+
+typedef struct DebugServer {
+    int listen_fd;                  // Listening socket
+    int client_fd;                  // Attached client, -1 if none
+    char in[SERVER_BUF_SIZE];       // Received bytes not yet handled
+    int in_len;
+    char out[SERVER_BUF_SIZE * 2];  // Replies not yet sent
+    int out_len;
+    bool waiting;                   // Client is waiting for a stop reply
+    bool killed;                    // Client killed the program, stop running
+} DebugServer;
+
+DebugServer* open_debug_server(const char* addr);   // Port or unix:<path>
+void poll_debug_server(DebugServer* srv, Chip8* chip);
+void wait_debug_server(DebugServer* srv, int ms);   // Block for client input
+void close_debug_server(DebugServer* srv);
+
+#endif  // DEBUG_SERVER_H
@@ -0,0 +1,114 @@
+#include <stdio.h>
+
+#include "decode.h"
+
+// Decoder table, operand templates are expanded by disassemble():
+//   X - x register, Y - y register, N - low nibble,
+//   K - 8bit immediate, A - 12bit address
+static const OpInfo op_table[] = {
+    {0xffff, 0x00e0, "cls",       "",                 0, ISA_CHIP8},
+    {0xffff, 0x00ee, "ret",       "",                 FLOW_RET, ISA_CHIP8},
+    {0xfff0, 0x00c0, "scd",       "N",                0, ISA_SCHIP},
+    {0xfff0, 0x00d0, "scu",       "N",                0, ISA_XOCHIP},
+    {0xffff, 0x00fb, "scr",       "",                 0, ISA_SCHIP},
+    {0xffff, 0x00fc, "scl",       "",                 0, ISA_SCHIP},
+    {0xffff, 0x00fd, "exit",      "",                 FLOW_EXIT, ISA_SCHIP},
+    {0xffff, 0x00fe, "low",       "",                 0, ISA_SCHIP},
+    {0xffff, 0x00ff, "high",      "",                 0, ISA_SCHIP},
+    {0xf000, 0x1000, "jp",        "A",                FLOW_JUMP, ISA_CHIP8},
+    {0xf000, 0x2000, "call",      "A",                FLOW_CALL, ISA_CHIP8},
+    {0xf000, 0x3000, "se",        "[vX], K",          FLOW_SKIP, ISA_CHIP8},
+    {0xf000, 0x4000, "sne",       "[vX], K",          FLOW_SKIP, ISA_CHIP8},
+    {0xf00f, 0x5000, "se",        "[vX], [vY]",       FLOW_SKIP, ISA_CHIP8},
+    {0xf00f, 0x5002, "str",       "[i], [vX] - [vY]", 0, ISA_XOCHIP},
+    {0xf00f, 0x5003, "ld",        "[vX] - [vY], [i]", 0, ISA_XOCHIP},
+    {0xf000, 0x6000, "ld",        "[vX], K",          0, ISA_CHIP8},
+    {0xf000, 0x7000, "addnc",     "[vX], K",          0, ISA_CHIP8},
+    {0xf00f, 0x8000, "ld",        "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x8001, "or",        "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x8002, "and",       "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x8003, "xor",       "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x8004, "add",       "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x8005, "sub",       "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x8006, "shr",       "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x8007, "subn",      "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x800e, "shl",       "[vX], [vY]",       0, ISA_CHIP8},
+    {0xf00f, 0x9000, "sne",       "[vX], [vY]",       FLOW_SKIP, ISA_CHIP8},
+    {0xf000, 0xa000, "ldi",       "A",                0, ISA_CHIP8},
+    {0xf000, 0xb000, "jp",        "A + [v0]",         FLOW_JUMP | FLOW_INDIRECT, ISA_CHIP8},
+    {0xf000, 0xc000, "rnd",       "[vX], K",          0, ISA_CHIP8},
+    {0xf00f, 0xd000, "drw",       "[vX], [vY], 16x16", 0, ISA_SCHIP},
+    {0xf000, 0xd000, "drw",       "[vX], [vY], N",    0, ISA_CHIP8},
+    {0xf0ff, 0xe09e, "skp",       "[vX]",             FLOW_SKIP, ISA_CHIP8},
+    {0xf0ff, 0xe0a1, "sknp",      "[vX]",             FLOW_SKIP, ISA_CHIP8},
+    {0xffff, 0xf000, "ldi long",  "",                 FLOW_LONG, ISA_XOCHIP},
+    {0xf0ff, 0xf001, "plane",     "X",                0, ISA_XOCHIP},
+    {0xffff, 0xf002, "ld audio",  "[i]",              0, ISA_XOCHIP},
+    {0xf0ff, 0xf007, "ld",        "[vX], [delay]",    0, ISA_CHIP8},
+    {0xf0ff, 0xf00a, "ld",        "[vX], [key]",      0, ISA_CHIP8},
+    {0xf0ff, 0xf015, "ld",        "[delay], [vX]",    0, ISA_CHIP8},
+    {0xf0ff, 0xf018, "ld",        "[sound], [vX]",    0, ISA_CHIP8},
+    {0xf0ff, 0xf01e, "add",       "[i], [vX]",        0, ISA_CHIP8},
+    {0xf0ff, 0xf029, "ld sprite", "[i], [vX]",        0, ISA_CHIP8},
+    {0xf0ff, 0xf030, "ld big sprite", "[i], [vX]",    0, ISA_SCHIP},
+    {0xf0ff, 0xf03a, "ld pitch",  "[vX]",             0, ISA_XOCHIP},
+    {0xf0ff, 0xf033, "ld bcd",    "[i], [vX]",        0, ISA_CHIP8},
+    {0xf0ff, 0xf055, "str",       "[i], [v0] - [vX]", 0, ISA_CHIP8},
+    {0xf0ff, 0xf065, "ld",        "[v0] - [vX], [i]", 0, ISA_CHIP8},
+    {0xf0ff, 0xf075, "str",       "[flags], [v0] - [vX]", 0, ISA_SCHIP},
+    {0xf0ff, 0xf085, "ld",        "[v0] - [vX], [flags]", 0, ISA_SCHIP},
+};
+
+#define OP_COUNT (sizeof(op_table) / sizeof(op_table[0]))
+
+// Look up opcode in decoder table, NULL if undefined
+const OpInfo* decode_op(uint16_t opc) {
+    for (size_t i = 0; i < OP_COUNT; i++) {
+        if ((opc & op_table[i].mask) == op_table[i].match)
+            return &op_table[i];
+    }
+    return NULL;
+}
+
+// Return length of instruction in bytes, XO-CHIP's long ld i takes 4
+int op_length(uint16_t opc) {
+    const OpInfo* op = decode_op(opc);
+    return op != NULL && op->flow & FLOW_LONG ? 4 : 2;
+}
+
+// Return 12bit address operand of opcode
+uint16_t op_target(uint16_t opc) {
+    return opc & 0x0fff;
+}
+
+// Format opcode as assembly text, returns number of characters written
+int disassemble(uint16_t opc, char* buf, size_t n) {
+
+    const OpInfo* op = decode_op(opc);
+    if (op == NULL)
+        return snprintf(buf, n, "UNDEFINED OPCODE");
+
+    int len = snprintf(buf, n, "%s", op->name);
+    if (op->operands[0] != '\0' && len >= 0 && (size_t)len < n)
+        len += snprintf(buf + len, n - len, " ");
+
+    // Expand operand template
+    for (const char* c = op->operands; *c && len >= 0 && (size_t)len < n; c++) {
+        switch (*c) {
+        case 'X': len += snprintf(buf + len, n - len, "%x", (opc >> 8) & 0xf);
+                  break;
+        case 'Y': len += snprintf(buf + len, n - len, "%x", (opc >> 4) & 0xf);
+                  break;
+        case 'N': len += snprintf(buf + len, n - len, "%d", opc & 0xf);
+                  break;
+        case 'K': len += snprintf(buf + len, n - len, "%d", opc & 0xff);
+                  break;
+        case 'A': len += snprintf(buf + len, n - len, "0x%03x", opc & 0xfff);
+                  break;
+        default:  len += snprintf(buf + len, n - len, "%c", *c);
+                  break;
+        }
+    }
+
+    return len;
+}
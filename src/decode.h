@@ -0,0 +1,35 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Control flow flags
+#define FLOW_JUMP       (1 << 0)    // Unconditional transfer to target
+#define FLOW_CALL       (1 << 1)    // Subroutine call, returns to next op
+#define FLOW_RET        (1 << 2)    // Return from subroutine
+#define FLOW_SKIP       (1 << 3)    // Conditionally skip next instruction
+#define FLOW_INDIRECT   (1 << 4)    // Target depends on register contents
+#define FLOW_LONG       (1 << 5)    // Followed by a 16bit operand word
+#define FLOW_EXIT       (1 << 6)    // Stops the interpreter
+
+// Instruction sets
+#define ISA_CHIP8       (0)
+#define ISA_SCHIP       (1)
+#define ISA_XOCHIP      (2)
+
+typedef struct OpInfo {
+    uint16_t mask;          // Bits which identify the opcode
+    uint16_t match;         // Value of identifying bits
+    const char* name;       // Mnemonic
+    const char* operands;   // Operand template (X, Y, N, K, A placeholders)
+    uint8_t flow;           // Control flow flags
+    uint8_t isa;            // Instruction set that introduced the opcode
+} OpInfo;
+
+const OpInfo* decode_op(uint16_t opc);              // Look up opcode info
+uint16_t op_target(uint16_t opc);                   // Address operand
+int disassemble(uint16_t opc, char* buf, size_t n); // Format opcode as text
+int op_length(uint16_t opc);                        // Bytes, 2 or 4
+
+#endif  // DECODE_H
@@ -1,24 +1,82 @@
+#include <time.h>
+
 #include "../include/raylib.h"
 #include "display.h"
 #include "chip8.h"
+#include "analysis.h"
+#include "debug.h"
+#include "input.h"
+#include "font.h"
+
+// Panels, built the first time they are shown
+static bool debug_ui;           // Panels can be shown
+static bool panels;             // Panels shown
+static bool font_loaded;
+static Font font;
 
-#define FONT_PATH "lib/Courier New Bold.ttf"
+// Frame timing
+static double init_time;        // When init_display() was called
+static double first_frame;      // Seconds to the first frame, -1 before it
+static long game_frames;        // Frames drawn without panels
+static double game_time;
+static long panel_frames;       // Frames drawn with panels
+static double panel_time;
 
-Font db_font;
-Font ram_font;
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
 
-// Initialize Window
-void init_display(void) {
+// Initialize Window at game size, panels can be shown later if debug is set
+void init_display(bool debug) {
 
-    InitWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "chip-8");
-    db_font = LoadFontEx(FONT_PATH,  DEBUG_TEXT_SIZE, 0, 250);
-    ram_font = LoadFontEx(FONT_PATH, RAM_TEXT_SIZE,   0, 250);
+    init_time = now();
+    first_frame = -1;
+    debug_ui = debug;
+    panels = false;
+    InitWindow(DISPLAY_WIDTH, DISPLAY_HEIGHT, "chip-8");
 
 }
 
+// Show or hide debug and RAM panels, loading the font the first time
+void show_panels(bool show) {
+
+    if (!debug_ui || show == panels) return;
+    if (show && !font_loaded) {
+        font = load_bitmap_font();
+        font_loaded = true;
+    }
+    panels = show;
+    if (show) SetWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
+    else SetWindowSize(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+}
+
+// Return if panels are shown
+bool panels_shown(void) {
+    return panels;
+}
+
+// Draw calls made for the current frame
+static int draws;
+
+// Draw rectangle, counting the call
+static void draw_rect(int x, int y, int w, int h, Color c) {
+    DrawRectangle(x, y, w, h, c);
+    draws++;
+}
+
+// Draw text, counting the call
+static void draw_text(Font f, const char* text, Vector2 pos, int size,
+                      int spacing, Color c) {
+    DrawTextEx(f, text, pos, size, spacing, c);
+    draws++;
+}
+
 // Draw Pixel to Window
-void draw_pixel(uint8_t x, uint8_t y, Color c) {
-    DrawRectangle(x * PIXEL_SIZE,y * PIXEL_SIZE,PIXEL_SIZE,PIXEL_SIZE,c);
+void draw_pixel(uint8_t x, uint8_t y, int size, Color c) {
+    draw_rect(x * size, y * size, size, size, c);
 }
 
 // Check if window is still open
@@ -26,23 +84,43 @@ bool display_is_open(void) {
     return !WindowShouldClose();
 }
 
-// Get Current Keypad Inputs
-uint16_t get_keypad_inputs(void) {
-    
-    // Keys corresponding to 0-F inputs
-    int key_dict[] = {KEY_X, KEY_ONE, KEY_TWO, KEY_THREE,
-                    KEY_Q, KEY_W, KEY_E, KEY_A,
-                    KEY_S, KEY_D, KEY_Z, KEY_C,
-                    KEY_FOUR, KEY_R, KEY_F, KEY_V};
-
-    // Read keys from bottom up
-    uint16_t keypad = 0;
+// Keys corresponding to 0-F inputs
+static const int key_dict[] = {KEY_X, KEY_ONE, KEY_TWO, KEY_THREE,
+                               KEY_Q, KEY_W, KEY_E, KEY_A,
+                               KEY_S, KEY_D, KEY_Z, KEY_C,
+                               KEY_FOUR, KEY_R, KEY_F, KEY_V};
+
+// Hex key for keyboard key, or -1
+static int hex_key(int code) {
+    for (int k = 0; k < 16; k++)
+        if (key_dict[k] == code) return k;
+    return -1;
+}
+
+// Queue keypad changes since the last call, timestamped on arrival
+void read_key_events(Input* in) {
+
+    double t = input_now();
+    uint16_t held = 0;
     for (int k = 15; k >= 0; k--) {
-        keypad = keypad << 1;
-        keypad = keypad | IsKeyDown(key_dict[k]);
+        held = held << 1;
+        held = held | IsKeyDown(key_dict[k]);
     }
 
-    return keypad;
+    uint16_t changed = held ^ in->held;
+    for (int k = 0; k < 16; k++) {
+        if ((changed >> k) & 1) push_key_event(in, t, k, (held >> k) & 1);
+    }
+
+    // A press released before the poll only shows in the pressed queue
+    for (int code = GetKeyPressed(); code != 0; code = GetKeyPressed()) {
+        int k = hex_key(code);
+        if (k >= 0 && !((held >> k) & 1) && !((changed >> k) & 1)) {
+            push_key_event(in, t, k, true);
+            push_key_event(in, t + INPUT_TAP, k, false);
+        }
+    }
+    in->held = held;
 }
 
 // Return if spacebar is pressed
@@ -60,59 +138,90 @@ bool is_enter_pressed(void) {
     return IsKeyPressed(KEY_ENTER);
 }
 
-// Update Display Window
-void update_display(Chip8* chip) {
+// Return if tab is pressed
+bool is_tab_pressed(void) {
+    return IsKeyPressed(KEY_TAB);
+}
 
-    // First clear display
-    BeginDrawing();
-    ClearBackground(WHITE);
+// Return RAM address clicked in RAM panel, or -1 if none
+int get_ram_click(void) {
+
+    if (!panels || !IsMouseButtonPressed(MOUSE_BUTTON_LEFT)) return -1;
 
-    // Now draw VM video memory
-    for (int y = 0; y < VID_HEIGHT; y++) {
-        for (int x = 0; x < VID_WIDTH; x++) {
-            if (chip->vid[y * VID_WIDTH + x] == 1)
-                draw_pixel(x,y,WHITE);
-            else draw_pixel(x,y,BLACK);
+    // Invert RAM panel layout from update_display()
+    Vector2 m = GetMousePosition();
+    float size = RAM_TEXT_SIZE;
+    float left = RAM_X + RAM_TEXT_SIZE/4 + (size * .5) * 6;
+    float top = RAM_Y + RAM_TEXT_SIZE/4 + size;
+    int col = (m.x - left) / ((size * .5) * 3);
+    int row = (m.y - top) / size;
+    if (m.x < left || m.y < top || col >= 64 || row >= 64) return -1;
+
+    return row * 64 + col;
+}
+
+// Draw VM video memory at its current resolution, one color per combination
+// of lit planes
+static void draw_game(Chip8* chip) {
+
+    Color colors[] = {BLACK, WHITE, GRAY, DARKGRAY};
+    int width = chip->vid.hires ? HIRES_WIDTH : VID_WIDTH;
+    int height = chip->vid.hires ? HIRES_HEIGHT : VID_HEIGHT;
+    int step = SCREEN_WIDTH / width;
+    draw_rect(0, 0, DISPLAY_WIDTH, DISPLAY_HEIGHT, BLACK);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t p = get_pixel(&chip->vid, x * step, y * step);
+            if (p) draw_pixel(x, y, DISPLAY_WIDTH / width, colors[p]);
         }
     }
+}
+
+// Draw registers, stack and keypad
+static void draw_debug_panel(Chip8* chip) {
 
-    // Draw Debug Information
     Vector2 cursor = {DEBUG_X + DEBUG_TEXT_SIZE/5, DEBUG_Y};
     int size = DEBUG_TEXT_SIZE;
     int spacing = 0;
-    DrawRectangle(DEBUG_X, DEBUG_Y, DEBUG_WIDTH, DEBUG_HEIGHT, BLUE);
+    draw_rect(DEBUG_X, DEBUG_Y, DEBUG_WIDTH, DEBUG_HEIGHT, BLUE);
 
     // First Draw Special Registers
-    DrawTextEx(db_font, TextFormat("Chip-8 Debug Information"),
+    draw_text(font, TextFormat("Chip-8 Debug Information"),
+                cursor, size, spacing, WHITE);
+    cursor.y += size;
+    draw_text(font, TextFormat("Special", chip->pc),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
-    DrawTextEx(db_font, TextFormat("Special", chip->pc),
+    draw_text(font, TextFormat("PC: %d", chip->pc),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
-    DrawTextEx(db_font, TextFormat("PC: %d", chip->pc),
+    draw_text(font, TextFormat("I:  %d", chip->i),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
-    DrawTextEx(db_font, TextFormat("I:  %d", chip->i),
+    draw_text(font, TextFormat("SP: %d", chip->sp),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
-    DrawTextEx(db_font, TextFormat("SP: %d", chip->sp),
+    draw_text(font, TextFormat("DT: %d", chip->delay),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
-    DrawTextEx(db_font, TextFormat("DT: %d", chip->delay),
+    draw_text(font, TextFormat("ST: %d", chip->sound),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
-    DrawTextEx(db_font, TextFormat("ST: %d", chip->sound),
+    draw_text(font, TextFormat("EX: %ld", chip->last_exec),
+                cursor, size, spacing, WHITE);
+    cursor.y += size;
+    draw_text(font, TextFormat("YD: %ld", chip->last_yield),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
     
     // Next Draw General Registers
     cursor.x += 6 * size;
     cursor.y = DEBUG_Y + size;
-    DrawTextEx(db_font, TextFormat("General", chip->pc),
+    draw_text(font, TextFormat("General", chip->pc),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
     for (uint8_t i = 0; i <= 0xf; i++) {
-        DrawTextEx(db_font, TextFormat("[v%x]: %d", i, chip->reg[i]),
+        draw_text(font, TextFormat("[v%x]: %d", i, chip->reg[i]),
                     cursor, size, spacing, WHITE);
         cursor.y += size;
 
@@ -121,14 +230,14 @@ void update_display(Chip8* chip) {
     // Next Draw Stack
     cursor.x += 6 * size;
     cursor.y = DEBUG_Y + size;
-    DrawTextEx(db_font, TextFormat("Stack", chip->pc),
+    draw_text(font, TextFormat("Stack", chip->pc),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
     for (uint8_t i = 0; i <= 0xf; i++) {
-        DrawTextEx(db_font, TextFormat(" [%x]: %d", i, chip->stack[i]),
+        draw_text(font, TextFormat(" [%x]: %d", i, chip->stack[i]),
                     cursor, size, spacing, WHITE);
         if (chip->sp == i)
-            DrawTextEx(db_font, TextFormat(">", i, chip->stack[i]),
+            draw_text(font, TextFormat(">", i, chip->stack[i]),
                     cursor, size, spacing, WHITE);
         cursor.y += size;
 
@@ -142,7 +251,7 @@ void update_display(Chip8* chip) {
     int keypad_left = cursor.x + 8 * size;
     cursor.x = keypad_left;
     cursor.y = DEBUG_Y + size;
-    DrawTextEx(db_font, TextFormat("Inputs"),
+    draw_text(font, TextFormat("Inputs"),
                 cursor, size, spacing, WHITE);
     Vector2 keysize = {DEBUG_KEY_SIZE - 1, DEBUG_KEY_SIZE - 1};
     cursor.y += size;
@@ -157,8 +266,8 @@ void update_display(Chip8* chip) {
             txt_col = WHITE;
         }
 
-        DrawRectangleV(cursor, keysize, key_col);
-        DrawTextEx(db_font, TextFormat("%x", key),
+        draw_rect(cursor.x, cursor.y, keysize.x, keysize.y, key_col);
+        draw_text(font, TextFormat("%x", key),
                     cursor, size, spacing, txt_col);
         cursor.x += DEBUG_KEY_SIZE;
 
@@ -168,34 +277,73 @@ void update_display(Chip8* chip) {
         }
 
     }
-   
-    // Draw RAM contents
-    cursor.x = RAM_X + RAM_TEXT_SIZE/4;
-    cursor.y = RAM_Y + RAM_TEXT_SIZE/4;
-    size = RAM_TEXT_SIZE;
-    DrawRectangle(RAM_X, RAM_Y, RAM_WIDTH, RAM_HEIGHT, BLUE);
-    DrawTextEx(ram_font, TextFormat("RAM", chip->pc),
+}
+
+// Draw RAM contents, marking data, the pc and breakpoints
+static void draw_ram_panel(Chip8* chip) {
+
+    Vector2 cursor = {RAM_X + RAM_TEXT_SIZE/4, RAM_Y + RAM_TEXT_SIZE/4};
+    int size = RAM_TEXT_SIZE;
+    int spacing = 0;
+    draw_rect(RAM_X, RAM_Y, RAM_WIDTH, RAM_HEIGHT, BLUE);
+    draw_text(font, TextFormat("RAM", chip->pc),
                 cursor, size, spacing, WHITE);
     cursor.y += size;
     for (uint8_t j = 0; j < 64; j++) {
-        DrawTextEx(ram_font, TextFormat("%03x: ", j * 64),
+        draw_text(font, TextFormat("%03x: ", j * 64),
                     cursor, size, spacing, WHITE);
         cursor.x += (size * .5) * 6;
         for (uint8_t i = 0; i < 64; i++) {
             Color c = WHITE;
+            if (chip->analysis != NULL
+                && chip->analysis->map[j * 64 + i] == MAP_DATA) c = SKYBLUE;
             if (chip->pc == j * 64 + i) c = RED;
-            DrawTextEx(ram_font, TextFormat("%02x ", chip->ram[64 * j + i]),
+            if (has_breakpoint(chip, j * 64 + i))
+                draw_rect(cursor.x, cursor.y, (size * .5) * 2, size, MAROON);
+            draw_text(font, TextFormat("%02x ", chip->ram[64 * j + i]),
                         cursor, size, spacing, c);
             cursor.x += (size * .5) * 3;
         }
         cursor.x = RAM_X + RAM_TEXT_SIZE/4;
         cursor.y += size;
     }
+}
+
+// Update Display Window, returns draw calls made
+int update_display(Chip8* chip) {
 
+    double start = now();
+    draws = 0;
+    BeginDrawing();
+    ClearBackground(WHITE);
+    draw_game(chip);
+    if (panels) {
+        draw_debug_panel(chip);
+        draw_ram_panel(chip);
+    }
     EndDrawing();
+
+    double end = now();
+    if (first_frame < 0) first_frame = end - init_time;
+    if (panels) {
+        panel_frames++;
+        panel_time += end - start;
+    } else {
+        game_frames++;
+        game_time += end - start;
+    }
+    return draws;
 }
 
-// Close Window
+// Close Window and report frame timing
 void end_display(void) {
+
+    printf("display: first frame %.1f ms after init, %ld game only frames "
+           "%.3f ms avg, %ld with panels %.3f ms avg\n", 1000 * first_frame,
+           game_frames, game_frames ? 1000 * game_time / game_frames : 0,
+           panel_frames, panel_frames ? 1000 * panel_time / panel_frames : 0);
+
+    if (font_loaded) UnloadFont(font);
+    font_loaded = false;
     CloseWindow();
 }
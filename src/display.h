@@ -2,6 +2,7 @@
 #define DISPLAY_H
 
 #include "chip8.h"
+#include "input.h"
 
 // Video Display Panel
 #define PIXEL_SIZE      (10)
@@ -23,19 +24,23 @@
 #define RAM_X           (0)
 #define RAM_Y           (DISPLAY_HEIGHT)
 
-// Window
+// Window with panels, without them it is the display panel alone
 #define WINDOW_WIDTH    (DISPLAY_WIDTH + DEBUG_WIDTH)
 #define WINDOW_HEIGHT   (DISPLAY_HEIGHT + RAM_HEIGHT)
 
-void init_display(void);
-void update_display(Chip8* chip);
+void init_display(bool debug);
+void show_panels(bool show);
+bool panels_shown(void);
+int update_display(Chip8* chip);
 void end_display(void);
 
 bool display_is_open(void);
-uint16_t get_keypad_inputs(void);
+void read_key_events(Input* in);
 bool is_space_pressed(void);
 bool is_p_pressed(void);
 bool is_enter_pressed(void);
+bool is_tab_pressed(void);
+int get_ram_click(void);
 
 #endif  // DISPLAY_H
 
@@ -0,0 +1,16 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../include/raylib.h"
+
+#define FONT_FIRST      (0x20)      // First character, space
+#define FONT_GLYPHS     (95)        // Printable ASCII
+#define FONT_WIDTH      (6)         // Cell size in pixels, 5x7 glyph with
+#define FONT_HEIGHT     (8)         // a blank column and row
+
+Font load_bitmap_font(void);
+
+#endif  // FONT_H
@@ -0,0 +1,63 @@
+#include "hash.h"
+
+// Hash of plane p from scratch, the sum of its weighted rows
+uint64_t hash_plane(const Frame* f, int p) {
+    uint64_t h = 0;
+    uint64_t w = 1;
+    for (int y = 0; y < HIRES_HEIGHT; y++, w *= HASH_ROW_STEP)
+        h += hash_bits(p, f->rows[p][y]) * w;
+    return h;
+}
+
+// Row weights of the plane hashes, filled by start_hashing()
+uint64_t hash_row_weight[HIRES_HEIGHT];
+
+// Keep incremental hashes current from now on. Plain interpreting leaves
+// them alone, so it pays nothing for the frame tables
+void start_hashing(Chip8* chip) {
+    uint64_t w = 1;
+    for (int y = 0; y < HIRES_HEIGHT; y++, w *= HASH_ROW_STEP)
+        hash_row_weight[y] = w;
+    chip->hashing = true;
+    rehash_state(chip);
+}
+
+// Recompute incremental hashes from scratch, after writes outside the helpers
+void rehash_state(Chip8* chip) {
+    if (!chip->hashing) return;
+    uint64_t h = 0;
+    for (uint32_t r = 0; r < sizeof(chip->reg); r++)
+        h ^= hash_byte(HASH_REG + r, chip->reg[r]);
+    for (uint32_t a = 0; a <= chip->ram_mask; a++)
+        h ^= hash_byte(HASH_RAM + a, chip->ram[a]);
+    chip->hash = h;
+    for (int p = 0; p < VID_PLANES; p++)
+        chip->vid_hash[p] = hash_plane(&chip->vid, p);
+}
+
+// Mix value into hash
+static uint64_t mix(uint64_t h, uint64_t v) {
+    h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    return h * 0xd6e8feb86659fd93ull;
+}
+
+// Hash of full machine state: incremental parts plus the small registers
+uint64_t state_hash(const Chip8* chip) {
+    uint64_t h = chip->hash;
+    for (int p = 0; p < VID_PLANES; p++) h = mix(h, chip->vid_hash[p]);
+    h = mix(h, chip->pc);
+    h = mix(h, chip->i);
+    h = mix(h, chip->sp);
+    for (int s = 0; s < 16; s++) h = mix(h, chip->stack[s]);
+    h = mix(h, chip->delay);
+    h = mix(h, chip->sound);
+    h = mix(h, chip->keypad);
+    h = mix(h, chip->rng);
+    h = mix(h, chip->vblank_wait);
+    h = mix(h, chip->vid.hires);
+    h = mix(h, chip->planes);
+    for (int r = 0; r < 16; r++) h = mix(h, chip->rpl[r]);
+    for (int b = 0; b < 16; b++) h = mix(h, chip->pattern[b]);
+    h = mix(h, chip->pitch);
+    return h;
+}
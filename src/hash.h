@@ -0,0 +1,65 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "chip8.h"
+
+// Hash locations, one per byte or word of hashed state
+#define HASH_REG    (0x00000)       // Registers v0-vf
+#define HASH_RAM    (0x00100)       // RAM, up to 64K
+
+// Row weights of the plane hashes
+#define HASH_ROW_STEP (0x9e3779b97f4a7c15ull)   // Weight of the next row down
+#define HASH_ROW_BACK (0xf1de83e19937733dull)   // Inverse mod 2^64
+
+// Contribution of one byte to the state hash, zero bytes contribute nothing.
+// The state hash is the XOR of all contributions, so a write updates it with
+// hash ^= hash_byte(loc, old) ^ hash_byte(loc, new)
+static inline uint64_t hash_byte(uint32_t loc, uint8_t val) {
+    if (val == 0) return 0;
+    uint64_t h = ((uint64_t)loc << 8 | val) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 32;
+    h *= 0xd6e8feb86659fd93ull;
+    return h ^ (h >> 32);
+}
+
+// Contribution of one 64bit word, zero words contribute nothing
+static inline uint64_t hash_word(uint32_t loc, uint64_t val) {
+    if (val == 0) return 0;
+    uint64_t h = (val ^ (uint64_t)loc << 40) * 0x9e3779b97f4a7c15ull;
+    h ^= h >> 29;
+    h *= 0xd6e8feb86659fd93ull;
+    return h ^ (h >> 32);
+}
+
+extern uint64_t hash_row_weight[HIRES_HEIGHT]; // HASH_ROW_STEP^y
+
+// Step raised to the nth power, mod 2^64
+static inline uint64_t hash_pow(uint64_t step, int n) {
+    uint64_t r = 1;
+    for (; n > 0; n >>= 1, step *= step)
+        if (n & 1) r *= step;
+    return r;
+}
+
+// Unweighted contribution of a row of plane p, zero rows contribute nothing.
+// Lighter than hash_word, scrolls rehash whole planes
+static inline uint64_t hash_bits(int p, Row r) {
+    uint64_t h = (uint64_t)(r >> 64) * 0x9e3779b97f4a7c15ull ^
+                 (uint64_t)r * (0xd6e8feb86659fd93ull + 2 * p);
+    return h ^ (h >> 32);
+}
+
+// Contribution of row y of plane p. A plane hash is the sum of its rows mod
+// 2^64, row y weighted by HASH_ROW_STEP^y, so scrolling the plane n rows
+// multiplies the rows left on screen by HASH_ROW_STEP^n. A write updates it
+// with hash += hash_row(p, y, new) - hash_row(p, y, old)
+static inline uint64_t hash_row(int p, int y, Row r) {
+    return hash_bits(p, r) * hash_row_weight[y];
+}
+
+void start_hashing(Chip8* chip);            // Keep hashes from now on
+void rehash_state(Chip8* chip);             // Recompute incremental hashes
+uint64_t hash_plane(const Frame* f, int p); // Plane hash from scratch
+uint64_t state_hash(const Chip8* chip);     // Hash of full machine state
+
+#endif  // HASH_H
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+#include "input.h"
+
+#define QUEUE_MASK (INPUT_QUEUE_SIZE - 1)
+
+// Seconds on the monotonic clock, the time base of live key events
+double input_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Parse script line "<ms> <key> down|up", in emulated milliseconds from
+// the start. Returns 1 for an event, 0 for a blank or comment line and -1
+// if the line is malformed
+static int parse_line(const char* line, KeyEvent* e) {
+
+    char first[2];
+    if (sscanf(line, " %1s", first) != 1 || first[0] == '#') return 0;
+
+    double ms;
+    unsigned key;
+    char dir[8];
+    if (sscanf(line, "%lf %x %7s", &ms, &key, dir) != 3 || key > 0xf)
+        return -1;
+    if (strcmp(dir, "down") != 0 && strcmp(dir, "up") != 0) return -1;
+
+    e->time = ms / 1000;
+    e->key = key;
+    e->down = strcmp(dir, "down") == 0;
+    return 1;
+}
+
+// Check every line of the script before running it, false on the first
+// malformed one
+static bool check_script(FILE* f, const char* path) {
+
+    char line[128];
+    KeyEvent e;
+    for (long n = 1; fgets(line, sizeof(line), f) != NULL; n++) {
+        if (parse_line(line, &e) < 0) {
+            line[strcspn(line, "\r\n")] = '\0';
+            printf("input: %s:%ld: expected \"<ms> <key> down|up\", got "
+                   "\"%s\"\n", path, n, line);
+            return false;
+        }
+    }
+    rewind(f);
+    return true;
+}
+
+// Queue scripted events while there is room
+static void refill(Input* in) {
+
+    char line[128];
+    KeyEvent e;
+    while (in->script != NULL && in->head - in->tail < INPUT_QUEUE_SIZE) {
+        if (fgets(line, sizeof(line), in->script) == NULL) {
+            fclose(in->script);
+            in->script = NULL;
+            break;
+        }
+        if (parse_line(line, &e) > 0) push_key_event(in, e.time, e.key, e.down);
+    }
+}
+
+// Start an event queue, fed by a script if given, otherwise by live keys
+Input* open_input(const char* script) {
+
+    Input* in = calloc(1, sizeof(Input));
+    if (in == NULL) return NULL;
+
+    if (script != NULL) {
+        in->clock = INPUT_EMULATED;
+        in->script = fopen(script, "r");
+        if (in->script == NULL || !check_script(in->script, script)) {
+            if (in->script != NULL) fclose(in->script);
+            free(in);
+            return NULL;
+        }
+        refill(in);
+    } else {
+        in->clock = INPUT_WALL;
+    }
+
+    for (int k = 0; k < 16; k++) in->pending[k] = -1;
+    in->last_batch = input_now();
+    in->due = LONG_MAX;
+    return in;
+}
+
+// Queue key transition, false if the queue is full
+bool push_key_event(Input* in, double time, uint8_t key, bool down) {
+    if (in->head - in->tail == INPUT_QUEUE_SIZE) {
+        in->lost++;
+        return false;
+    }
+    KeyEvent* e = &in->queue[in->head++ & QUEUE_MASK];
+    e->time = time;
+    e->key = key & 0xf;
+    e->down = down;
+    in->events++;
+    return true;
+}
+
+// Cycle at which an event time falls in the current frame
+static long event_cycle(const Input* in, double time) {
+    double f = (time - in->window_start) / in->window_len;
+    if (f < 0) f = 0;
+    return in->frame_cycle + (long)(f * in->frame_cycles);
+}
+
+// Cycle of next event in this frame's window
+static long next_due(const Input* in) {
+    if (in->head == in->tail) return LONG_MAX;
+    const KeyEvent* e = &in->queue[in->tail & QUEUE_MASK];
+    if (e->time >= in->window_start + in->window_len) return LONG_MAX;
+    return event_cycle(in, e->time);
+}
+
+// Apply oldest event to the keypad
+static void apply_event(Input* in, Chip8* chip) {
+    const KeyEvent* e = &in->queue[in->tail++ & QUEUE_MASK];
+    if (e->down) chip->keypad |= 1 << e->key;
+    else chip->keypad &= ~(1 << e->key);
+    in->pending[e->key] = e->time;
+}
+
+// Map the frame about to run onto event time. Live keys fill the frame with
+// what happened since the previous one ran, scripted keys use its emulated
+// time. Events land at the same fraction of the frame's cycles
+void start_input_frame(Input* in, const Chip8* chip, long target) {
+
+    if (in->clock == INPUT_WALL) {
+        double t = input_now();
+        in->window_start = in->last_batch;
+        in->window_len = t - in->last_batch;
+        in->last_batch = t;
+    } else {
+        in->window_start = chip->clocks / chip->clock_f;
+        in->window_len = 1 / chip->clock_f;
+    }
+    if (in->window_len <= 0) in->window_len = 1e-9;
+    in->frame_cycle = chip->cycles;
+    in->frame_cycles = target - chip->cycles;
+
+    refill(in);
+    in->due = next_due(in);
+}
+
+// Apply events due at or before the current cycle
+void apply_input(Input* in, Chip8* chip) {
+    while (in->head != in->tail && next_due(in) <= chip->cycles)
+        apply_event(in, chip);
+    refill(in);
+    in->due = next_due(in);
+}
+
+// Apply every event up to now, for execution paced in real time. Scripted
+// time is counted in cycles run, which the window loop restarts from 0 when
+// execution resumes, so they are totalled here
+void apply_input_now(Input* in, Chip8* chip) {
+    long run = chip->cycles - in->last_cycles;
+    in->cycles_run += run >= 0 ? run : chip->cycles;
+    in->last_cycles = chip->cycles;
+
+    double t = in->clock == INPUT_WALL ? input_now()
+             : in->cycles_run / chip->cycle_f;
+    while (in->head != in->tail && in->queue[in->tail & QUEUE_MASK].time <= t)
+        apply_event(in, chip);
+    refill(in);
+}
+
+// Time of the executing instruction, in the clock of the events
+static double input_time(const Input* in, const Chip8* chip) {
+    if (in->clock == INPUT_WALL) return input_now();
+    double f = in->frame_cycles > 0
+             ? (double)(chip->cycles - in->frame_cycle) / in->frame_cycles : 0;
+    return in->window_start + f * in->window_len;
+}
+
+// First look at a key since it changed
+void record_observation(Input* in, const Chip8* chip, uint8_t key) {
+
+    double latency = input_time(in, chip) - in->pending[key];
+    in->pending[key] = -1;
+    if (latency < 0) latency = 0;
+
+    in->observed++;
+    in->latency_sum += latency;
+    if (latency > in->latency_max) in->latency_max = latency;
+
+    int b = 0;
+    while (b < INPUT_BUCKETS - 1 && latency * 1000 >= (1 << b)) b++;
+    in->hist[b]++;
+}
+
+// Report latency statistics and free queue
+void close_input(Input* in) {
+
+    printf("input: %ld events, %ld lost, %ld observed, latency avg %.2f ms, "
+           "max %.2f ms\n", in->events, in->lost, in->observed,
+           in->observed ? 1000 * in->latency_sum / in->observed : 0,
+           1000 * in->latency_max);
+    if (in->observed > 0) {
+        printf("input: latency ms");
+        for (int b = 0; b < INPUT_BUCKETS; b++) {
+            if (b < INPUT_BUCKETS - 1) printf(" <%d:%ld", 1 << b, in->hist[b]);
+            else printf(" >=%d:%ld", 1 << (b - 1), in->hist[b]);
+        }
+        printf("\n");
+    }
+
+    if (in->script != NULL) fclose(in->script);
+    free(in);
+}
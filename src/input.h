@@ -0,0 +1,72 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include "chip8.h"
+
+#define INPUT_QUEUE_SIZE    (64)        // Power of two
+#define INPUT_TAP           (1 / 60.0)  // Seconds held for a press and release
+                                        // seen in one poll
+#define INPUT_BUCKETS       (8)         // Latency histogram, doubling from 1ms
+
+typedef enum {
+    INPUT_WALL,             // Event times on the monotonic clock, live keys
+    INPUT_EMULATED,         // Event times in emulated seconds, scripted keys
+} InputClock;
+
+typedef struct KeyEvent {
+    double time;            // When the key changed
+    uint8_t key;            // Hex key 0-f
+    bool down;              // Pressed or released
+} KeyEvent;
+
+typedef struct Input {
+
+    // Event queue, oldest first
+    InputClock clock;
+    KeyEvent queue[INPUT_QUEUE_SIZE];
+    unsigned head;          // Next slot to write
+    unsigned tail;          // Next event to apply
+    uint16_t held;          // Keys down as last seen by the source
+    FILE* script;           // Scripted events still to be queued, if any
+    long events;            // Events queued
+    long lost;              // Events lost to a full queue
+
+    // Current frame: events in the time window are spread over its cycles
+    double window_start;
+    double window_len;
+    double last_batch;      // Wall time the previous frame ran
+    long frame_cycle;       // Cycle count at the start of the frame
+    long frame_cycles;      // Cycles in the frame
+    long due;               // Cycle the next event applies at, LONG_MAX if
+                            // none this frame
+
+    // Execution paced in real time
+    long cycles_run;        // Cycles run, never reset
+    long last_cycles;       // chip->cycles when last seen
+
+    // Input to skp, sknp and Fx0A observation latency
+    double pending[16];     // Time of unobserved change per key, or -1
+    long observed;
+    double latency_sum;
+    double latency_max;
+    long hist[INPUT_BUCKETS];
+
+} Input;
+
+Input* open_input(const char* script);
+bool push_key_event(Input* in, double time, uint8_t key, bool down);
+void start_input_frame(Input* in, const Chip8* chip, long target);
+void apply_input(Input* in, Chip8* chip);
+void apply_input_now(Input* in, Chip8* chip);
+void record_observation(Input* in, const Chip8* chip, uint8_t key);
+void close_input(Input* in);
+double input_now(void);
+
+// Note that the program looked at key, cheap unless it changed since
+static inline void observe_key(Chip8* chip, uint8_t key) {
+    Input* in = chip->input;
+    if (in != NULL && in->pending[key & 0xf] >= 0)
+        record_observation(in, chip, key & 0xf);
+}
+
+#endif  // INPUT_H
@@ -1,19 +1,184 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "chip8.h"
+#include "debug.h"
+#include "debug_server.h"
+#include "capture.h"
+#include "stream.h"
+#include "audio.h"
+#include "input.h"
+#include "metrics.h"
 
 int main(int argc, char** argv) {
 
     Chip8* chip = calloc(1, sizeof(Chip8));
     init_chip8(chip);
 
-    if (argc > 1) {
-        load_rom(chip, argv[1]);
+    const char* rom = NULL;
+    long headless = -1;
+    const char* capture = NULL;
+    int scale = 1;
+    const char* audio = NULL;
+    unsigned audio_ring = 0;
+    unsigned audio_period = AUDIO_PERIOD;
+    bool audio_latency = false;
+    const char* input = NULL;
+    const char* metrics = NULL;
+    unsigned metrics_period = METRICS_PERIOD;
+    for (int i = 1; i < argc; i++) {
+        char* arg = argv[i];
+        char* val = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "-b") == 0 && val) {
+            // Breakpoint: -b <addr>
+            toggle_breakpoint(chip, strtol(val, NULL, 0));
+            i++;
+        } else if ((strcmp(arg, "-w") == 0 || strcmp(arg, "-r") == 0) && val) {
+            // Watchpoint: -w|-r <addr>[:len]
+            char* end;
+            uint16_t addr = strtol(val, &end, 0);
+            uint16_t len = *end == ':' ? strtol(end + 1, NULL, 0) : 1;
+            add_watchpoint(chip, addr, len,
+                           arg[1] == 'w' ? WATCH_WRITE : WATCH_READ);
+            i++;
+        } else if (strcmp(arg, "-c") == 0 && val) {
+            // Conditional breakpoint: -c <addr>:v<x>=<val>
+            int addr, cmp;
+            unsigned reg;
+            if (sscanf(val, "%i:v%x=%i", &addr, &reg, &cmp) == 3)
+                add_condition(chip, addr, reg, cmp);
+            i++;
+        } else if (strcmp(arg, "--checked") == 0) {
+            // Report wrapped memory accesses and stack over/underflow
+            set_checked(chip, true);
+        } else if (strcmp(arg, "--schip") == 0) {
+            // SUPER-CHIP: 128x64 hires, scrolling and 16x16 sprites
+            set_mode(chip, MODE_SCHIP);
+        } else if (strcmp(arg, "--xochip") == 0) {
+            // XO-CHIP: 64K memory and two bitplanes on top of SUPER-CHIP
+            set_mode(chip, MODE_XOCHIP);
+        } else if (strcmp(arg, "--headless") == 0 && val) {
+            // Run without window for n frames, 0 for no limit
+            headless = strtol(val, NULL, 0);
+            chip->trace = false;
+            i++;
+        } else if (strcmp(arg, "--fast") == 0) {
+            chip->throttle = false;
+        } else if (strcmp(arg, "--gdb") == 0 && val) {
+            // Debug server: --gdb <port>|unix:<path>
+            chip->server = open_debug_server(val);
+            if (chip->server == NULL) {
+                printf("Unable to open debug server on %s\n", val);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(arg, "--capture") == 0 && val) {
+            // Capture frames: --capture <file.y4m>|<png pattern>
+            capture = val;
+            i++;
+        } else if (strcmp(arg, "--stream") == 0 && val) {
+            // Spectator stream: --stream <port>|unix:<path>
+            chip->stream = open_stream_server(val);
+            if (chip->stream == NULL) {
+                printf("Unable to open stream server on %s\n", val);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(arg, "--scale") == 0 && val) {
+            scale = strtol(val, NULL, 0);
+            i++;
+        } else if (strcmp(arg, "--audio") == 0 && val) {
+            // Sound output: --audio device|null|<file.wav>
+            audio = val;
+            i++;
+        } else if (strcmp(arg, "--audio-ring") == 0 && val) {
+            audio_ring = strtoul(val, NULL, 0);
+            i++;
+        } else if (strcmp(arg, "--audio-period") == 0 && val) {
+            audio_period = strtoul(val, NULL, 0);
+            i++;
+        } else if (strcmp(arg, "--audio-latency") == 0) {
+            audio_latency = true;
+        } else if (strcmp(arg, "--input") == 0 && val) {
+            // Scripted keys: --input <file> of "<ms> <key> down|up" lines
+            input = val;
+            i++;
+        } else if (strcmp(arg, "--no-debug") == 0) {
+            // Game only window, no panels or text
+            chip->debug_ui = false;
+        } else if (strcmp(arg, "--metrics") == 0 && val) {
+            // Metrics export: --metrics <file>|<port>|unix:<path>
+            metrics = val;
+            i++;
+        } else if (strcmp(arg, "--metrics-period") == 0 && val) {
+            metrics_period = strtoul(val, NULL, 0);
+            i++;
+        } else {
+            rom = arg;
+        }
+    }
+
+    if (capture != NULL) {
+        chip->capture = open_capture(capture, scale, chip->clock_f);
+        if (chip->capture == NULL) {
+            printf("Unable to start capture to %s\n", capture);
+            return 1;
+        }
+    }
+
+    if (audio != NULL) {
+        chip->audio = open_audio(audio, audio_ring, audio_period,
+                                 chip->clock_f, audio_latency);
+        if (chip->audio == NULL) {
+            printf("Unable to start audio on %s\n", audio);
+            return 1;
+        }
+    }
+
+    if (metrics != NULL) {
+        chip->metrics = open_metrics(metrics, metrics_period, chip);
+        if (chip->metrics == NULL) {
+            printf("Unable to export metrics to %s\n", metrics);
+            return 1;
+        }
+    }
+
+    // The window always reads live keys through the event queue
+    if (input != NULL || headless < 0) {
+        chip->input = open_input(input);
+        if (chip->input == NULL) {
+            printf("Unable to open key events %s\n", input ? input : "queue");
+            return 1;
+        }
+    }
+
+    if (rom != NULL) {
+        load_rom(chip, rom);
+        attach_analysis(chip, rom);
     } else {
-        printf("Usage: chip8 <path_to_rom>");
+        printf("Usage: chip8 [-b addr] [-w|-r addr[:len]] [-c addr:vX=val] "
+               "[--checked] [--schip|--xochip] [--no-debug] "
+               "[--headless frames] [--fast] [--gdb port|unix:path] "
+               "[--capture file.y4m|pattern] [--scale n] "
+               "[--stream port|unix:path] "
+               "[--audio device|null|file.wav] [--audio-ring n] "
+               "[--audio-period n] [--audio-latency] [--input keys.txt] "
+               "[--metrics file|port|unix:path] [--metrics-period ms] "
+               "<path_to_rom>");
     }
 
-    run(chip);
+    if (headless >= 0) run_headless(chip, headless);
+    else run(chip);
+
+    if (chip->debug != NULL && chip->debug->violations > 0)
+        printf("%ld memory model violations\n", chip->debug->violations);
+    if (chip->server != NULL) close_debug_server(chip->server);
+    if (chip->capture != NULL) close_capture(chip->capture);
+    if (chip->stream != NULL) close_stream_server(chip->stream);
+    if (chip->audio != NULL) close_audio(chip->audio);
+    if (chip->input != NULL) close_input(chip->input);
+    if (chip->metrics != NULL) close_metrics(chip->metrics);
 
 }
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "metrics.h"
+#include "net.h"
+
+#define HTTP_HEADER "HTTP/1.0 200 OK\r\n" \
+                    "Content-Type: text/plain; version=0.0.4\r\n\r\n"
+
+static const struct {
+    const char* name;
+    const char* help;
+} counter_info[COUNT_TOTAL] = {
+    [COUNT_INSTRUCTIONS] = {"chip8_instructions_total", "Instructions executed"},
+    [COUNT_YIELDED]      = {"chip8_yielded_cycles_total",
+                            "Cycles idled waiting for vblank"},
+    [COUNT_FRAMES]       = {"chip8_frames_total", "Timer ticks sent"},
+    [COUNT_DROPPED]      = {"chip8_dropped_frames_total",
+                            "Timer ticks missed by falling behind"},
+    [COUNT_RENDERS]      = {"chip8_renders_total", "Window frames drawn"},
+    [COUNT_DRAW_CALLS]   = {"chip8_draw_calls_total",
+                            "Rectangles and text drawn to the window"},
+    [COUNT_DRW]          = {"chip8_drw_total", "Sprites drawn by the program"},
+    [COUNT_COLLISIONS]   = {"chip8_drw_collisions_total",
+                            "Sprites drawn over lit pixels"},
+    [COUNT_KEY_WAIT]     = {"chip8_key_wait_cycles_total",
+                            "Cycles blocked on Fx0A"},
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+} hist_info[HIST_TOTAL] = {
+    [HIST_TICK_LATE] = {"chip8_tick_late_seconds",
+                        "Timer tick interval beyond the clock period"},
+    [HIST_RENDER]    = {"chip8_render_seconds", "Time to draw the window"},
+    [HIST_KEY_WAIT]  = {"chip8_key_wait_seconds",
+                        "Time each Fx0A blocked, in emulated seconds"},
+};
+
+// Seconds on the monotonic clock
+double metrics_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Load counter for export
+static unsigned long counter(Metrics* m, CounterId id) {
+    return atomic_load_explicit(&m->counters[id], memory_order_relaxed);
+}
+
+// Record observation in histogram, emulation thread only
+void observe_metric(Metrics* m, HistogramId id, double seconds) {
+
+    Histogram* h = &m->hist[id];
+    int b = 0;
+    double bound = METRICS_BASE;
+    while (b < METRICS_BUCKETS - 1 && seconds > bound) {
+        bound *= 2;
+        b++;
+    }
+
+    atomic_ulong* v = &h->buckets[b];
+    atomic_store_explicit(v, atomic_load_explicit(v, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&h->sum_ns, atomic_load_explicit(&h->sum_ns,
+                          memory_order_relaxed) + (unsigned long)(seconds * 1e9),
+                          memory_order_relaxed);
+    atomic_store_explicit(&h->count, atomic_load_explicit(&h->count,
+                          memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Append formatted text, returns new length
+static int append(char* buf, int len, const char* fmt, ...) {
+    if (len >= METRICS_TEXT_SIZE) return len;
+    va_list args;
+    va_start(args, fmt);
+    len += vsnprintf(buf + len, METRICS_TEXT_SIZE - len, fmt, args);
+    va_end(args);
+    return len < METRICS_TEXT_SIZE ? len : METRICS_TEXT_SIZE - 1;
+}
+
+// Render registry in Prometheus text format, returns length. Values are
+// read one at a time, so a scrape may straddle an update
+static int render(Metrics* m, char* buf) {
+
+    int len = 0;
+    for (int c = 0; c < COUNT_TOTAL; c++) {
+        len = append(buf, len, "# HELP %s %s.\n# TYPE %s counter\n%s %lu\n",
+                     counter_info[c].name, counter_info[c].help,
+                     counter_info[c].name, counter_info[c].name,
+                     counter(m, c));
+    }
+
+    // Derived values, for readers without a query language
+    unsigned long drw = counter(m, COUNT_DRW);
+    len = append(buf, len, "# HELP chip8_key_wait_seconds_total Emulated "
+                 "time blocked on Fx0A.\n# TYPE chip8_key_wait_seconds_total "
+                 "counter\nchip8_key_wait_seconds_total %.6f\n",
+                 counter(m, COUNT_KEY_WAIT) / m->cycle_f);
+    len = append(buf, len, "# HELP chip8_instructions_per_second Instructions "
+                 "executed per second over the last period.\n# TYPE "
+                 "chip8_instructions_per_second gauge\n"
+                 "chip8_instructions_per_second %.1f\n", m->ips);
+    len = append(buf, len, "# HELP chip8_drw_collision_ratio Fraction of "
+                 "sprites drawn over lit pixels.\n# TYPE "
+                 "chip8_drw_collision_ratio gauge\nchip8_drw_collision_ratio "
+                 "%.6f\n", drw ? (double)counter(m, COUNT_COLLISIONS) / drw : 0);
+    len = append(buf, len, "# HELP chip8_timer_drift_seconds Last timer tick "
+                 "against its ideal time.\n# TYPE chip8_timer_drift_seconds "
+                 "gauge\nchip8_timer_drift_seconds %.6f\n",
+                 atomic_load_explicit(&m->drift_ns, memory_order_relaxed) / 1e9);
+
+    for (int h = 0; h < HIST_TOTAL; h++) {
+        Histogram* hist = &m->hist[h];
+        const char* name = hist_info[h].name;
+        len = append(buf, len, "# HELP %s %s.\n# TYPE %s histogram\n",
+                     name, hist_info[h].help, name);
+
+        unsigned long total = 0;
+        double bound = METRICS_BASE;
+        for (int b = 0; b < METRICS_BUCKETS; b++) {
+            total += atomic_load_explicit(&hist->buckets[b], memory_order_relaxed);
+            if (b < METRICS_BUCKETS - 1)
+                len = append(buf, len, "%s_bucket{le=\"%g\"} %lu\n",
+                             name, bound, total);
+            else
+                len = append(buf, len, "%s_bucket{le=\"+Inf\"} %lu\n",
+                             name, total);
+            bound *= 2;
+        }
+        len = append(buf, len, "%s_sum %.9f\n%s_count %lu\n", name,
+                     atomic_load_explicit(&hist->sum_ns, memory_order_relaxed)
+                     / 1e9, name, total);
+    }
+    return len;
+}
+
+// Replace file with a fresh export, readers never see a partial one
+static bool write_file(Metrics* m, const char* text, int len) {
+    char tmp[METRICS_PATH_SIZE + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", m->target);
+    FILE* f = fopen(tmp, "w");
+    if (f == NULL) return false;
+    bool ok = fwrite(text, 1, len, f) == (size_t)len;
+    ok = fclose(f) == 0 && ok;
+    return ok && rename(tmp, m->target) == 0;
+}
+
+// Read request up to the blank line ending its header, so closing the
+// socket doesn't reset the connection under a reply the client hasn't read
+static void read_request(int fd) {
+    char req[512];
+    size_t keep = 0;
+    double end = metrics_now() + METRICS_READ_TIME;
+    while (metrics_now() < end) {
+        ssize_t n = recv(fd, req + keep, sizeof(req) - 1 - keep, MSG_DONTWAIT);
+        if (n == 0) return;
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return;
+            struct timespec d = {0, 1000000};
+            nanosleep(&d, NULL);
+            continue;
+        }
+        size_t len = keep + n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") != NULL) return;
+
+        // Keep enough of the tail to find a terminator split across reads
+        keep = len < 3 ? len : 3;
+        memmove(req, req + len - keep, keep);
+    }
+}
+
+// Answer pending scrapes with the current registry, request is ignored
+static void serve_scrapes(Metrics* m, char* text) {
+    while (true) {
+        int fd = accept(m->listen_fd, NULL, NULL);
+        if (fd < 0) return;
+
+        read_request(fd);
+        int len = render(m, text);
+        send(fd, HTTP_HEADER, strlen(HTTP_HEADER), MSG_NOSIGNAL);
+        send(fd, text, len, MSG_NOSIGNAL);
+        close(fd);
+        m->exports++;
+    }
+}
+
+// Sample the instruction rate over the period just ended
+static void sample_rate(Metrics* m) {
+    double t = metrics_now();
+    unsigned long n = counter(m, COUNT_INSTRUCTIONS);
+    if (t > m->last_sample) m->ips = (n - m->last_instructions) / (t - m->last_sample);
+    m->last_instructions = n;
+    m->last_sample = t;
+}
+
+// Exporter thread, samples each period and writes or serves the registry
+static void* exporter_main(void* arg) {
+
+    Metrics* m = arg;
+    char* text = malloc(METRICS_TEXT_SIZE);
+    double next = metrics_now() + m->period / 1e3;
+    while (!atomic_load(&m->stop)) {
+
+        if (m->listen_fd >= 0) serve_scrapes(m, text);
+        if (metrics_now() >= next) {
+            next += m->period / 1e3;
+            sample_rate(m);
+            if (m->listen_fd < 0) {
+                if (!write_file(m, text, render(m, text))) m->failed = true;
+                m->exports++;
+            }
+        }
+
+        struct timespec d = {0, 10000000};
+        nanosleep(&d, NULL);
+    }
+
+    // Final values for a file
+    if (m->listen_fd < 0) {
+        sample_rate(m);
+        if (!write_file(m, text, render(m, text))) m->failed = true;
+        m->exports++;
+    }
+    free(text);
+    return NULL;
+}
+
+// True for a port number or unix:<path>
+static bool is_socket(const char* target) {
+    if (strncmp(target, "unix:", 5) == 0) return true;
+    for (const char* p = target; *p; p++)
+        if (!isdigit((unsigned char)*p)) return false;
+    return *target != 0;
+}
+
+// Start exporting metrics every period ms to a file, or serving them on a
+// localhost port or unix:<path>
+Metrics* open_metrics(const char* target, unsigned period, const Chip8* chip) {
+
+    Metrics* m = calloc(1, sizeof(Metrics));
+    if (m == NULL) return NULL;
+
+    snprintf(m->target, sizeof(m->target), "%s", target);
+    m->period = period > 0 ? period : METRICS_PERIOD;
+    m->clock_f = chip->clock_f;
+    m->cycle_f = chip->cycle_f;
+    m->wait_start = -1;
+    m->last_sample = metrics_now();
+    m->listen_fd = is_socket(target) ? listen_socket(target, 16) : -1;
+    atomic_init(&m->stop, false);
+    atomic_init(&m->drift_ns, 0);
+    for (int c = 0; c < COUNT_TOTAL; c++) atomic_init(&m->counters[c], 0);
+
+    bool ok = !is_socket(target) || m->listen_fd >= 0;
+    if (ok && m->listen_fd < 0) ok = write_file(m, "", 0);
+    if (!ok || pthread_create(&m->thread, NULL, exporter_main, m) != 0) {
+        if (m->listen_fd >= 0) close(m->listen_fd);
+        free(m);
+        return NULL;
+    }
+    return m;
+}
+
+// Timer tick, called from send_clock() before the frame counts reset.
+// Clock 0 restarts the ideal timeline, loop() resets it on state changes
+void metrics_clock(Metrics* m, const Chip8* chip) {
+
+    count_metric(m, COUNT_INSTRUCTIONS, chip->frame_exec);
+    count_metric(m, COUNT_YIELDED, chip->frame_yield);
+    count_metric(m, COUNT_FRAMES, 1);
+
+    double t = metrics_now();
+    double period = 1 / m->clock_f;
+    if (chip->clocks == 0 || m->last_tick == 0) {
+        m->base = t - chip->clocks * period;
+    } else {
+        double late = t - m->last_tick - period;
+        observe_metric(m, HIST_TICK_LATE, late > 0 ? late : 0);
+        long missed = (long)(late / period + 0.5);
+        if (missed > 0) count_metric(m, COUNT_DROPPED, missed);
+    }
+    m->last_tick = t;
+
+    double drift = t - (m->base + chip->clocks * period);
+    atomic_store_explicit(&m->drift_ns, (long)(drift * 1e9), memory_order_relaxed);
+}
+
+// Window drawn
+void metrics_render(Metrics* m, double seconds, int draws) {
+    count_metric(m, COUNT_RENDERS, 1);
+    count_metric(m, COUNT_DRAW_CALLS, draws);
+    observe_metric(m, HIST_RENDER, seconds);
+}
+
+// Fx0A executed, found is false while it blocks
+void metrics_key_wait(Metrics* m, const Chip8* chip, bool found) {
+    if (!found) {
+        count_metric(m, COUNT_KEY_WAIT, 1);
+        if (m->wait_start < 0) m->wait_start = chip->cycles;
+    } else if (m->wait_start >= 0) {
+        long n = chip->cycles - m->wait_start;
+        observe_metric(m, HIST_KEY_WAIT, (n > 0 ? n : 0) / m->cycle_f);
+        m->wait_start = -1;
+    }
+}
+
+// Stop exporter, write final values and report
+void close_metrics(Metrics* m) {
+
+    atomic_store(&m->stop, true);
+    pthread_join(m->thread, NULL);
+    if (m->listen_fd >= 0) close(m->listen_fd);
+
+    printf("metrics: %ld exports to %s%s\n", m->exports, m->target,
+           m->failed ? ", write FAILED" : "");
+    free(m);
+}
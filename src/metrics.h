@@ -0,0 +1,98 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "chip8.h"
+
+#define METRICS_BUCKETS     (20)        // Histogram buckets, doubling from
+#define METRICS_BASE        (10e-6)     // this many seconds
+#define METRICS_PERIOD      (1000)      // Default export period, ms
+#define METRICS_PATH_SIZE   (1024)
+#define METRICS_TEXT_SIZE   (16384)
+#define METRICS_READ_TIME   (0.1)       // Seconds to wait for a request
+
+typedef enum {
+    COUNT_INSTRUCTIONS,     // Instructions executed
+    COUNT_YIELDED,          // Cycles idled waiting for vblank
+    COUNT_FRAMES,           // Clock ticks sent
+    COUNT_DROPPED,          // Ticks that should have been sent but weren't
+    COUNT_RENDERS,          // Windows drawn
+    COUNT_DRAW_CALLS,       // Rectangles and text drawn to the window
+    COUNT_DRW,              // Sprites drawn by the program
+    COUNT_COLLISIONS,       // Sprites that set vF
+    COUNT_KEY_WAIT,         // Cycles blocked on Fx0A
+    COUNT_TOTAL,
+} CounterId;
+
+typedef enum {
+    HIST_TICK_LATE,         // Tick interval over the clock period
+    HIST_RENDER,            // Time to draw the window
+    HIST_KEY_WAIT,          // Length of each Fx0A block
+    HIST_TOTAL,
+} HistogramId;
+
+typedef struct Histogram {
+    atomic_ulong buckets[METRICS_BUCKETS];  // Observations per bucket, the
+                                            // last is unbounded
+    atomic_ulong count;
+    atomic_ulong sum_ns;
+} Histogram;
+
+typedef struct Metrics {
+
+    // Output
+    char target[METRICS_PATH_SIZE]; // File, or port or unix:<path>
+    int listen_fd;                  // Scrape socket, -1 for a file
+    unsigned period;                // Export period, ms
+    pthread_t thread;
+    atomic_bool stop;
+
+    // Registry. Written by the emulation thread only, so no value needs a
+    // locked update, and read by the exporter
+    atomic_ulong counters[COUNT_TOTAL];
+    Histogram hist[HIST_TOTAL];
+    atomic_long drift_ns;           // Last tick against the ideal tick time
+
+    // Emulation thread state
+    float clock_f;
+    float cycle_f;
+    double base;                    // Wall time of clock 0
+    double last_tick;               // Wall time of previous tick, 0 for none
+    long wait_start;                // Cycle Fx0A started blocking, -1 if not
+
+    // Exporter state
+    unsigned long last_instructions;
+    double last_sample;             // Wall time of previous rate sample
+    double ips;                     // Instructions per second over a period
+    long exports;                   // Files written or scrapes served
+    bool failed;                    // Output could not be written
+
+} Metrics;
+
+Metrics* open_metrics(const char* target, unsigned period, const Chip8* chip);
+void metrics_clock(Metrics* m, const Chip8* chip);
+void metrics_render(Metrics* m, double seconds, int draws);
+void metrics_key_wait(Metrics* m, const Chip8* chip, bool found);
+void observe_metric(Metrics* m, HistogramId id, double seconds);
+double metrics_now(void);
+void close_metrics(Metrics* m);
+
+// Add to counter. There is one writer, so a relaxed load and store is
+// enough and costs the same as a plain increment
+static inline void count_metric(Metrics* m, CounterId id, unsigned long n) {
+    atomic_ulong* c = &m->counters[id];
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n,
+                          memory_order_relaxed);
+}
+
+// Sprite drawn, collision in vF
+static inline void metrics_drw(Chip8* chip) {
+    Metrics* m = chip->metrics;
+    if (m == NULL) return;
+    count_metric(m, COUNT_DRW, 1);
+    if (chip->reg[0xf]) count_metric(m, COUNT_COLLISIONS, 1);
+}
+
+#endif  // METRICS_H
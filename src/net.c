@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "net.h"
+
+// Fill socket address for localhost port or unix:<path>
+static int make_addr(const char* addr, struct sockaddr_storage* ss,
+                     socklen_t* len) {
+    memset(ss, 0, sizeof(*ss));
+    if (strncmp(addr, "unix:", 5) == 0) {
+        struct sockaddr_un* sa = (struct sockaddr_un*)ss;
+        sa->sun_family = AF_UNIX;
+        strncpy(sa->sun_path, addr + 5, sizeof(sa->sun_path) - 1);
+        *len = sizeof(*sa);
+        return AF_UNIX;
+    }
+
+    struct sockaddr_in* sa = (struct sockaddr_in*)ss;
+    sa->sin_family = AF_INET;
+    sa->sin_port = htons(atoi(addr));
+    sa->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    *len = sizeof(*sa);
+    return AF_INET;
+}
+
+// Make socket non-blocking so polling never stalls the VM
+bool set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Open non-blocking listening socket, -1 on failure
+int listen_socket(const char* addr, int backlog) {
+
+    struct sockaddr_storage ss;
+    socklen_t len;
+    int family = make_addr(addr, &ss, &len);
+    if (family == AF_UNIX) unlink(((struct sockaddr_un*)&ss)->sun_path);
+
+    int fd = socket(family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int on = 1;
+    if (family == AF_INET)
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    if (bind(fd, (struct sockaddr*)&ss, len) < 0
+        || listen(fd, backlog) < 0 || !set_nonblocking(fd)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Connect blocking socket to server, -1 on failure
+int connect_socket(const char* addr) {
+
+    struct sockaddr_storage ss;
+    socklen_t len;
+    int family = make_addr(addr, &ss, &len);
+
+    int fd = socket(family, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr*)&ss, len) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -0,0 +1,16 @@
+#ifndef NET_H
+#define NET_H
+
+#include <stdbool.h>
+#include <sys/socket.h>
+
+// Platforms without it raise SIGPIPE on writes to a closed socket instead
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL (0)
+#endif
+
+int listen_socket(const char* addr, int backlog);   // Port or unix:<path>
+int connect_socket(const char* addr);               // Port or unix:<path>
+bool set_nonblocking(int fd);
+
+#endif  // NET_H
@@ -1,47 +1,155 @@
-#include <stdlib.h>
+#include <string.h>
 
 #include "chip8.h"
+#include "hash.h"
+#include "audio.h"
+#include "input.h"
+#include "metrics.h"
+
+// Write register, keeping the state hash current
+static inline void set_reg(Chip8* chip, uint8_t r, uint8_t val) {
+    if (chip->hashing)
+        chip->hash ^= hash_byte(HASH_REG + r, chip->reg[r])
+                    ^ hash_byte(HASH_REG + r, val);
+    chip->reg[r] = val;
+}
+
+// Write memory, keeping the state hash and guard mirror current. Writing
+// over translated code ends recompilation for good, recompiled code is
+// only attached in 4K mode so addr indexes the code map
+static inline void set_ram(Chip8* chip, uint16_t addr, uint8_t val) {
+    addr &= chip->ram_mask;
+    if (chip->hashing)
+        chip->hash ^= hash_byte(HASH_RAM + addr, chip->ram[addr])
+                    ^ hash_byte(HASH_RAM + addr, val);
+    chip->ram[addr] = val;
+    chip->ram[addr + (chip->ram_mask + 1) * (addr < RAM_GUARD)] = val;
+    if (chip->aot != NULL && chip->aot_code[addr]) chip->aot = NULL;
+}
 
-// XOR two values together
-uint8_t _xor(uint8_t x, uint8_t y) {
-    return (x || y) && !(x && y);
+// Skip next instruction, XO-CHIP's long ld i is 4 bytes. In the other modes
+// F000 is an undefined 2 byte opcode
+static inline void skip(Chip8* chip) {
+    uint16_t next = (chip->ram[chip->pc] << 8) + chip->ram[chip->pc + 1];
+    bool is_long = next == 0xf000 && chip->mode == MODE_XOCHIP;
+    chip->pc = (chip->pc + 2 + 2 * is_long) & chip->ram_mask;
+}
+
+// Columns of a row that are on screen
+static inline Row screen_mask(const Frame* f) {
+    return f->hires ? ~(Row)0 : ~(Row)0 << 64;
 }
 
 // Clear display
 void cls(Chip8* chip) {
-    for (int i = 0; i < VID_WIDTH*VID_HEIGHT; i++) chip->vid[i] = 0;
+    for (int p = 0; p < VID_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) continue;
+        memset(chip->vid.rows[p], 0, sizeof(chip->vid.rows[p]));
+        chip->vid_hash[p] = 0;
+    }
+}
+
+// Scroll selected planes down n rows
+void scd(Chip8* chip, uint8_t n) {
+    int h = chip->vid.hires ? HIRES_HEIGHT : VID_HEIGHT;
+    for (int p = 0; p < VID_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) continue;
+        Row* rows = chip->vid.rows[p];
+
+        // Rows that stay move n rows down, the rest drop off the bottom
+        if (chip->hashing) {
+            for (int y = h - n; y < h; y++)
+                chip->vid_hash[p] -= hash_row(p, y, rows[y]);
+            chip->vid_hash[p] *= hash_pow(HASH_ROW_STEP, n);
+        }
+
+        memmove(rows + n, rows, (h - n) * sizeof(Row));
+        memset(rows, 0, n * sizeof(Row));
+    }
+}
+
+// Scroll selected planes up n rows
+void scu(Chip8* chip, uint8_t n) {
+    int h = chip->vid.hires ? HIRES_HEIGHT : VID_HEIGHT;
+    for (int p = 0; p < VID_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) continue;
+        Row* rows = chip->vid.rows[p];
+
+        // Rows that stay move n rows up, the rest drop off the top
+        if (chip->hashing) {
+            for (int y = 0; y < n; y++)
+                chip->vid_hash[p] -= hash_row(p, y, rows[y]);
+            chip->vid_hash[p] *= hash_pow(HASH_ROW_BACK, n);
+        }
+
+        memmove(rows, rows + n, (h - n) * sizeof(Row));
+        memset(rows + h - n, 0, n * sizeof(Row));
+    }
+}
+
+// Scroll selected planes right 4 pixels
+void scr(Chip8* chip) {
+    Row mask = screen_mask(&chip->vid);
+    for (int p = 0; p < VID_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) continue;
+        for (int y = 0; y < HIRES_HEIGHT; y++)
+            chip->vid.rows[p][y] = (chip->vid.rows[p][y] >> 4) & mask;
+        if (chip->hashing) chip->vid_hash[p] = hash_plane(&chip->vid, p);
+    }
+}
+
+// Scroll selected planes left 4 pixels
+void scl(Chip8* chip) {
+    for (int p = 0; p < VID_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) continue;
+        for (int y = 0; y < HIRES_HEIGHT; y++)
+            chip->vid.rows[p][y] <<= 4;
+        if (chip->hashing) chip->vid_hash[p] = hash_plane(&chip->vid, p);
+    }
+}
+
+// Switch between 64x32 and 128x64, clearing the screen
+void set_hires(Chip8* chip, bool hires) {
+    memset(chip->vid.rows, 0, sizeof(chip->vid.rows));
+    memset(chip->vid_hash, 0, sizeof(chip->vid_hash));
+    chip->vid.hires = hires;
+}
+
+// Select planes for drawing, clearing and scrolling
+void plane(Chip8* chip, uint8_t mask) {
+    chip->planes = mask & ((1 << VID_PLANES) - 1);
 }
 
 // Return from subroutine
 void ret(Chip8* chip) {
     // Pop address from top of stack
     chip->pc = chip->stack[chip->sp];
-    chip->sp--;
+    chip->sp = (chip->sp - 1) & STACK_MASK;
 }
 
 // Jump
 void jp(Chip8* chip, uint16_t addr) {
-    chip->pc = addr;
+    chip->pc = addr & chip->ram_mask;
 }
 
 // Load value into register
 void ld(Chip8* chip, uint8_t dst, uint8_t val) {
-    chip->reg[dst] = val;
+    set_reg(chip, dst, val);
 }
 
 // Add value to register, don't set carry flag
 void addnc(Chip8* chip, uint8_t dst, uint8_t val) {
-    chip->reg[dst] += val;
+    set_reg(chip, dst, chip->reg[dst] + val);
 }
 
 // Add value to register
 void add(Chip8* chip, uint8_t dst, uint8_t val) {
     uint8_t x_init = chip->reg[dst];
-    chip->reg[dst] += val;
+    set_reg(chip, dst, x_init + val);
 
     uint8_t flag = 0;
     if (chip->reg[dst] < x_init) flag = 1;
-    chip->reg[0xf] = flag;
+    set_reg(chip, 0xf, flag);
 }
 
 // Load value into I register
@@ -49,40 +157,76 @@ void ldi(Chip8* chip, uint16_t addr) {
     chip->i = addr;
 }
 
-// Draw n-byte sprite to screen
+// Draw n-byte sprite to screen, or a 16x16 sprite for n = 0 outside CHIP-8.
+// Each sprite row is placed in a whole 128 pixel row and XORed in one go
 void drw(Chip8* chip, uint8_t xreg, uint8_t yreg, uint8_t n) {
 
+    Frame* f = &chip->vid;
+    int width = f->hires ? HIRES_WIDTH : VID_WIDTH;
+    int height = f->hires ? HIRES_HEIGHT : VID_HEIGHT;
+    Row mask = screen_mask(f);
+
     // Find drawing coordinates
-    uint8_t x = chip->reg[xreg] % VID_WIDTH;
-    uint8_t y = chip->reg[yreg] % VID_HEIGHT;
-
-    chip->reg[0xf] = 0;
-
-    // Read sprites, XOR to screen
-    for (int j = 0; (j < n) && (y + j < VID_HEIGHT); j++) {
-        // Grab sprite byte from memory
-        uint8_t sprite_byte = chip->ram[chip->i + j];
-        for (int i = 0; (i < 8) && (x + i < VID_WIDTH); i++) {
-            // Pick out sprite bit and current display bit, then xor
-            uint8_t sbit = (sprite_byte & (1 << (7 - i))) >> (7 - i);
-            uint8_t dbit = chip->vid[VID_WIDTH * (y + j) + x + i];
-            chip->vid[VID_WIDTH * (y + j) + x + i] = _xor(sbit, dbit);
-            // Set flag register if there was a collision
-            if (sbit && dbit) chip->reg[0xf] = 1;
+    int x = chip->reg[xreg] & (width - 1);
+    int y = chip->reg[yreg] & (height - 1);
+
+    int bits = 8;
+    int rows = n;
+    if (n == 0 && chip->mode != MODE_CHIP8) {
+        bits = 16;
+        rows = 16;
+    }
+
+    // Guard bytes cover both planes of a 16x16 sprite
+    uint8_t flag = 0;
+    const uint8_t* sprite = &chip->ram[chip->i & chip->ram_mask];
+
+    // Each selected plane takes the next sprite's worth of data
+    for (int p = 0; p < VID_PLANES; p++) {
+        if (!(chip->planes & (1 << p))) continue;
+
+        for (int j = 0; j < rows; j++) {
+            uint16_t bitmap = bits == 16 ? (sprite[0] << 8) + sprite[1]
+                                         : sprite[0];
+            sprite += bits / 8;
+
+            // Rows past the bottom are clipped or wrap to the top
+            int line = y + j;
+            if (line >= height) {
+                if (chip->quirk_clip) continue;
+                line -= height;
+            }
+
+            // Columns past the right edge are clipped or wrap to the left
+            Row s = (Row)bitmap << (128 - bits);
+            Row placed = s >> x;
+            if (!chip->quirk_clip && x > 0) placed |= s << (width - x);
+            placed &= mask;
+
+            Row* row = &f->rows[p][line];
+            flag |= (*row & placed) != 0;
+            if (chip->hashing) {
+                chip->vid_hash[p] += hash_row(p, line, *row ^ placed)
+                                   - hash_row(p, line, *row);
+            }
+            *row ^= placed;
         }
     }
+    set_reg(chip, 0xf, flag);
+    metrics_drw(chip);
+
+    // Rest of the frame waits for vblank
+    if (chip->quirk_disp_wait) chip->vblank_wait = true;
 }
 
 // Skip next instruction if reg equals immediate value
 void se(Chip8* chip, uint8_t reg, uint8_t val) {
-    if (chip->reg[reg] == val)
-        chip->pc = (chip->pc + 2) % 0xFFF;
+    if (chip->reg[reg] == val) skip(chip);
 }
 
 // Skip next instruction if reg equals immediate value
 void sne(Chip8* chip, uint8_t reg, uint8_t val) {
-    if (chip->reg[reg] != val)
-        chip->pc = (chip->pc + 2) % 0xFFF;
+    if (chip->reg[reg] != val) skip(chip);
 }
 
 // Return true if key is pressed
@@ -93,77 +237,82 @@ static bool key_is_pressed(Chip8* chip, uint8_t key) {
 
 // Skip next instruction if key is pressed
 void skp(Chip8* chip, uint8_t key) {
-    if (key_is_pressed(chip, key))
-        chip->pc = (chip->pc + 2) % 0xFFF;
+    observe_key(chip, key);
+    if (key_is_pressed(chip, key)) skip(chip);
 }
 
 // Skip next instruction if key is pressed
 void sknp(Chip8* chip, uint8_t key) {
-    if (!key_is_pressed(chip, key))
-        chip->pc = (chip->pc + 2) % 0xFFF;
+    observe_key(chip, key);
+    if (!key_is_pressed(chip, key)) skip(chip);
 }
 
 // Call subroutine
 void call(Chip8* chip, uint16_t addr) {
-    chip->sp++;
+    chip->sp = (chip->sp + 1) & STACK_MASK;
     chip->stack[chip->sp] = chip->pc;
     chip->pc = addr;
 }
 
 // OR Value with destination register
 void or(Chip8* chip, uint8_t dst, uint8_t val) {
-    chip->reg[dst] = chip->reg[dst] | val;
-    if (chip->quirk_vf_reset) chip->reg[0xf] = 0;
+    set_reg(chip, dst, chip->reg[dst] | val);
+    if (chip->quirk_vf_reset) set_reg(chip, 0xf, 0);
 }
 
 // AND value with destination register
 void and(Chip8* chip, uint8_t dst, uint8_t val) {
-    chip->reg[dst] = chip->reg[dst] & val;
-    if (chip->quirk_vf_reset) chip->reg[0xf] = 0;
+    set_reg(chip, dst, chip->reg[dst] & val);
+    if (chip->quirk_vf_reset) set_reg(chip, 0xf, 0);
 }
 
 // XOR value with destination register
 void xor(Chip8* chip, uint8_t dst, uint8_t val) {
     uint8_t x = chip->reg[dst];
     uint8_t y = val;
-    chip->reg[dst] = (x | y) & ~(x & y);
-    if (chip->quirk_vf_reset) chip->reg[0xf] = 0;
+    set_reg(chip, dst, (x | y) & ~(x & y));
+    if (chip->quirk_vf_reset) set_reg(chip, 0xf, 0);
 }
 
 // Subtract value from destination register
 void sub(Chip8* chip, uint8_t dst, uint8_t val) {
     uint8_t flag = chip->reg[dst] >= val;
-    chip->reg[dst] = chip->reg[dst] - val;
-    chip->reg[0xf] = flag;
+    set_reg(chip, dst, chip->reg[dst] - val);
+    set_reg(chip, 0xf, flag);
 }
 
 // Shift register right
 void shr(Chip8* chip, uint8_t dst, uint8_t val) {
-    (void) val;
-    uint8_t flag = chip->reg[dst] & 1;
-    chip->reg[dst] = chip->reg[dst] >> 1;
-    chip->reg[0xf] = flag;
+    uint8_t src = chip->quirk_shift ? chip->reg[dst] : val;
+    uint8_t flag = src & 1;
+    set_reg(chip, dst, src >> 1);
+    set_reg(chip, 0xf, flag);
 }
 
 // Subtract destination value from value
 void subn(Chip8* chip, uint8_t dst, uint8_t val) {
     uint8_t flag = val >= chip->reg[dst];
-    chip->reg[dst] = val - chip->reg[dst];
-    chip->reg[0xf] = flag;
+    set_reg(chip, dst, val - chip->reg[dst]);
+    set_reg(chip, 0xf, flag);
 }
 
 // Shift register left
 void shl(Chip8* chip, uint8_t dst, uint8_t val) {
-    (void) val;
-    uint8_t flag = (chip->reg[dst] & (1 << 7)) >> 7;
-    chip->reg[dst] = chip->reg[dst] << 1;
-    chip->reg[0xf] = flag;
+    uint8_t src = chip->quirk_shift ? chip->reg[dst] : val;
+    uint8_t flag = (src & (1 << 7)) >> 7;
+    set_reg(chip, dst, src << 1);
+    set_reg(chip, 0xf, flag);
 }
 
 // Generate random number, ANDed with value
 void rnd(Chip8* chip, uint8_t dst, uint8_t val) {
-    uint8_t r = rand() % 256;
-    chip->reg[dst] = r & val;
+    // xorshift32, kept in the machine state so runs are reproducible
+    uint32_t r = chip->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    chip->rng = r;
+    set_reg(chip, dst, (r >> 24) & val);
 }
 
 // Load value into delay timer
@@ -171,8 +320,10 @@ void ldd(Chip8* chip, uint8_t val) {
     chip->delay = val;
 }
 
-// Load value into delay timer
+// Load value into sound timer
 void lds(Chip8* chip, uint8_t val) {
+    if (chip->audio != NULL && (val > 0) != (chip->sound > 0))
+        audio_edge(chip->audio, chip, val > 0);
     chip->sound = val;
 }
 
@@ -188,24 +339,77 @@ void ld_sprite(Chip8* chip, uint8_t val) {
 
 // Load binary coded decimal value into i, i+1, i+2
 void ld_bcd(Chip8* chip, uint8_t val) {
-    chip->ram[chip->i] = val / 100;
-    chip->ram[chip->i + 1] = val % 100 / 10;
-    chip->ram[chip->i + 2] = val % 10;
+    set_ram(chip, chip->i, val / 100);
+    set_ram(chip, chip->i + 1, val % 100 / 10);
+    set_ram(chip, chip->i + 2, val % 10);
 }
 
 // Store registers 0-x in memory starting at i
 void str(Chip8* chip, uint8_t xreg) {
     for (uint8_t i = 0; i <= xreg; i++) {
-        chip->ram[chip->i + i] = chip->reg[i];
+        set_ram(chip, chip->i + i, chip->reg[i]);
     }
     if (chip->quirk_memory) chip->i += xreg;
 }
 
 // Load registers 0-x from memory starting at i
 void ldr(Chip8* chip, uint8_t xreg) {
+    const uint8_t* src = &chip->ram[chip->i & chip->ram_mask];
     for (uint8_t i = 0; i <= xreg; i++) {
-        chip->reg[i] = chip->ram[chip->i + i];
+        set_reg(chip, i, src[i]);
     }
     if (chip->quirk_memory) chip->i += xreg;
 }
 
+// Load big char pointer into i
+void ld_sprite_big(Chip8* chip, uint8_t val) {
+    chip->i = BIG_FONT_VECTOR + 10 * (val & 0xf);
+}
+
+// Load i from the word following the instruction, XO-CHIP
+void ldi_long(Chip8* chip) {
+    chip->i = (chip->ram[chip->pc] << 8) + chip->ram[chip->pc + 1];
+    chip->pc = (chip->pc + 2) & chip->ram_mask;
+}
+
+// Store registers x-y in memory starting at i, in either order, i unchanged
+void str_range(Chip8* chip, uint8_t xreg, uint8_t yreg) {
+    int dir = xreg <= yreg ? 1 : -1;
+    for (int r = xreg, a = 0; ; r += dir, a++) {
+        set_ram(chip, chip->i + a, chip->reg[r]);
+        if (r == yreg) break;
+    }
+}
+
+// Load registers x-y from memory starting at i, in either order, i unchanged
+void ldr_range(Chip8* chip, uint8_t xreg, uint8_t yreg) {
+    const uint8_t* src = &chip->ram[chip->i & chip->ram_mask];
+    int dir = xreg <= yreg ? 1 : -1;
+    for (int r = xreg, a = 0; ; r += dir, a++) {
+        set_reg(chip, r, src[a]);
+        if (r == yreg) break;
+    }
+}
+
+// Save registers 0-x to flag registers
+void save_flags(Chip8* chip, uint8_t xreg) {
+    for (uint8_t r = 0; r <= xreg; r++) chip->rpl[r] = chip->reg[r];
+}
+
+// Load registers 0-x from flag registers
+void load_flags(Chip8* chip, uint8_t xreg) {
+    for (uint8_t r = 0; r <= xreg; r++) set_reg(chip, r, chip->rpl[r]);
+}
+
+// Load 16 byte audio pattern from i, XO-CHIP
+void load_pattern(Chip8* chip) {
+    if (chip->audio != NULL) audio_tone(chip->audio, chip);
+    memcpy(chip->pattern, &chip->ram[chip->i & chip->ram_mask],
+           sizeof(chip->pattern));
+}
+
+// Set audio pattern playback pitch, XO-CHIP
+void set_pitch(Chip8* chip, uint8_t val) {
+    if (chip->audio != NULL) audio_tone(chip->audio, chip);
+    chip->pitch = val;
+}
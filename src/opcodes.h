@@ -32,5 +32,23 @@ void ld_bcd(Chip8* chip, uint8_t val);
 void str(Chip8* chip, uint8_t xreg);
 void ldr(Chip8* chip, uint8_t xreg);
 
+// SUPER-CHIP
+void scd(Chip8* chip, uint8_t n);
+void scr(Chip8* chip);
+void scl(Chip8* chip);
+void set_hires(Chip8* chip, bool hires);
+void ld_sprite_big(Chip8* chip, uint8_t val);
+void save_flags(Chip8* chip, uint8_t xreg);
+void load_flags(Chip8* chip, uint8_t xreg);
+
+// XO-CHIP
+void scu(Chip8* chip, uint8_t n);
+void plane(Chip8* chip, uint8_t mask);
+void ldi_long(Chip8* chip);
+void str_range(Chip8* chip, uint8_t xreg, uint8_t yreg);
+void ldr_range(Chip8* chip, uint8_t xreg, uint8_t yreg);
+void load_pattern(Chip8* chip);
+void set_pitch(Chip8* chip, uint8_t val);
+
 #endif // INSTRUCTIONS_H
 
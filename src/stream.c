@@ -0,0 +1,338 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "stream.h"
+#include "net.h"
+
+// Seconds on given clock
+static double seconds(clockid_t clk) {
+    struct timespec t;
+    clock_gettime(clk, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Encode zero runs and literal runs, returns encoded length.
+// Control byte 0x80|n-1 is n zero bytes, n-1 is n literal bytes following
+int rle_encode(const uint8_t* in, int len, uint8_t* out) {
+    int o = 0;
+    int i = 0;
+    while (i < len) {
+        int run = 0;
+        while (i + run < len && in[i + run] == 0 && run < 128) run++;
+        if (run >= 2 || (run == 1 && i + 1 == len)) {
+            out[o++] = 0x80 | (run - 1);
+            i += run;
+            continue;
+        }
+
+        // Literal run ends where a zero run worth encoding starts
+        int start = i;
+        int n = 0;
+        while (i < len && n < 128) {
+            if (in[i] == 0 && (i + 1 == len || in[i + 1] == 0)) break;
+            i++;
+            n++;
+        }
+        out[o++] = n - 1;
+        memcpy(out + o, in + start, n);
+        o += n;
+    }
+    return o;
+}
+
+// XOR decoded runs into frame, returns -1 if payload is malformed
+int rle_xor_decode(const uint8_t* in, int len, uint8_t* frame, int size) {
+    int pos = 0;
+    int i = 0;
+    while (i < len) {
+        uint8_t c = in[i++];
+        int n = (c & 0x7f) + 1;
+        if (pos + n > size) return -1;
+        if (c & 0x80) {
+            pos += n;
+            continue;
+        }
+        if (i + n > len) return -1;
+        for (int k = 0; k < n; k++) frame[pos++] ^= in[i++];
+    }
+    return pos == size ? 0 : -1;
+}
+
+// Pack video memory into bits at screen resolution, lit in any plane
+static void pack_frame(const Frame* vid, uint8_t* out) {
+    for (int b = 0; b < STREAM_FRAME_SIZE; b++) {
+        int x = b * 8 % SCREEN_WIDTH;
+        int y = b * 8 / SCREEN_WIDTH;
+        uint8_t v = 0;
+        for (int k = 0; k < 8; k++) v = (v << 1) | (get_pixel(vid, x + k, y) != 0);
+        out[b] = v;
+    }
+}
+
+// Write little endian integer
+static void put_le(uint8_t* p, uint32_t v, int n) {
+    for (int i = 0; i < n; i++) p[i] = v >> (8 * i);
+}
+
+// Build message for viewer at base, -1 base makes a keyframe
+static int build_message(StreamServer* srv, long base, uint8_t* msg) {
+    static const uint8_t blank[STREAM_FRAME_SIZE];
+    const uint8_t* cur = srv->history[srv->frame % STREAM_HISTORY];
+    const uint8_t* ref = base < 0 ? blank : srv->history[base % STREAM_HISTORY];
+
+    uint8_t x[STREAM_FRAME_SIZE];
+    for (int b = 0; b < STREAM_FRAME_SIZE; b++) x[b] = cur[b] ^ ref[b];
+    int len = rle_encode(x, STREAM_FRAME_SIZE, msg + STREAM_HEADER_SIZE);
+
+    msg[0] = base < 0 ? STREAM_KEYFRAME : STREAM_DELTA;
+    put_le(msg + 1, srv->frame, 4);
+    put_le(msg + 5, base < 0 ? 0 : base, 4);
+    put_le(msg + 9, len, 2);
+    return STREAM_HEADER_SIZE + len;
+}
+
+// Accept pending viewers
+static void accept_viewers(StreamServer* srv) {
+    while (srv->nviewers < STREAM_MAX_VIEWERS) {
+        int fd = accept(srv->listen_fd, NULL, NULL);
+        if (fd < 0) return;
+        if (!set_nonblocking(fd)) {
+            close(fd);
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        Viewer* v = &srv->viewers[srv->nviewers++];
+        memset(v, 0, sizeof(*v));
+        v->fd = fd;
+        v->acked = -1;      // Keyframe on subscribe
+        v->sent = -1;
+        v->key = -1;
+        if (srv->nviewers > srv->peak_viewers) srv->peak_viewers = srv->nviewers;
+    }
+}
+
+// Read acknowledgements, returns false if viewer went away
+static bool read_acks(StreamServer* srv, Viewer* v) {
+    uint8_t buf[64];
+    ssize_t n = recv(v->fd, buf, sizeof(buf), 0);
+    if (n == 0) return false;
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+
+    for (ssize_t i = 0; i < n; i++) {
+        v->in[v->in_len++] = buf[i];
+        if (v->in_len < 4) continue;
+        long ack = v->in[0] | v->in[1] << 8 | v->in[2] << 16
+                 | (uint32_t)v->in[3] << 24;
+        if (ack <= srv->frame && ack > v->acked) v->acked = ack;
+        v->in_len = 0;
+    }
+    return true;
+}
+
+// Send queued bytes, returns false if viewer went away
+static bool flush_viewer(StreamServer* srv, Viewer* v) {
+    if (v->out_len == 0) return true;
+    ssize_t n = send(v->fd, v->out, v->out_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+    memmove(v->out, v->out + n, v->out_len - n);
+    v->out_len -= n;
+    srv->bytes += n;
+    return true;
+}
+
+// Take newest frame from the emulation thread if it changed
+static bool take_frame(StreamServer* srv, unsigned* seen) {
+    unsigned s1 = atomic_load_explicit(&srv->seq, memory_order_acquire);
+    if (s1 == *seen || (s1 & 1)) return false;
+
+    uint8_t tmp[STREAM_FRAME_SIZE];
+    memcpy(tmp, srv->latest, sizeof(tmp));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&srv->seq, memory_order_relaxed) != s1)
+        return false;   // Torn read, try next tick
+
+    *seen = s1;
+    srv->frame++;
+    memcpy(srv->history[srv->frame % STREAM_HISTORY], tmp, sizeof(tmp));
+    return true;
+}
+
+// Wake the server thread. A full pipe already holds a wake up
+static void wake_server(StreamServer* srv) {
+    uint8_t b = 0;
+    ssize_t n = write(srv->wake[1], &b, 1);
+    (void)n;
+}
+
+// Wait for new frames, viewers and socket readiness, then read and flush
+// the viewers that are ready. Returns false if nothing happened
+static bool wait_ready(StreamServer* srv, unsigned* seen) {
+
+    struct pollfd* fds = srv->fds;
+    fds[0] = (struct pollfd){srv->listen_fd,
+                             srv->nviewers < STREAM_MAX_VIEWERS ? POLLIN : 0, 0};
+    fds[1] = (struct pollfd){srv->wake[0], POLLIN, 0};
+    for (int i = 0; i < srv->nviewers; i++) {
+        Viewer* v = &srv->viewers[i];
+        short events = POLLIN | (v->out_len > 0 ? POLLOUT : 0);
+        fds[i + 2] = (struct pollfd){v->fd, events, 0};
+    }
+    if (poll(fds, srv->nviewers + 2, STREAM_WAIT_MS) <= 0) return false;
+
+    // Backwards, so viewers moved into a closed slot were already served
+    for (int i = srv->nviewers - 1; i >= 0; i--) {
+        Viewer* v = &srv->viewers[i];
+        short ev = fds[i + 2].revents;
+        bool alive = !(ev & (POLLIN | POLLHUP | POLLERR)) || read_acks(srv, v);
+        if (alive && (ev & POLLOUT)) alive = flush_viewer(srv, v);
+        if (!alive) {
+            close(v->fd);
+            srv->viewers[i] = srv->viewers[--srv->nviewers];
+        }
+    }
+
+    if (fds[0].revents & POLLIN) accept_viewers(srv);
+    if (fds[1].revents & POLLIN) {
+        uint8_t buf[64];
+        while (read(srv->wake[0], buf, sizeof(buf)) > 0) {}
+    }
+    take_frame(srv, seen);
+    return true;
+}
+
+// Server thread, sleeps until a frame, a viewer or a socket needs it
+static void* server_main(void* arg) {
+
+    StreamServer* srv = arg;
+    unsigned seen = 0;
+    double wall = seconds(CLOCK_MONOTONIC);
+
+    // Encoded messages, shared by viewers with the same base this frame
+    static uint8_t cache[STREAM_HISTORY + 1][STREAM_HEADER_SIZE
+                                            + STREAM_MAX_PAYLOAD];
+    int cache_len[STREAM_HISTORY + 1];
+
+    while (!atomic_load(&srv->stop)) {
+
+        if (!wait_ready(srv, &seen)) continue;
+        for (int c = 0; c <= STREAM_HISTORY; c++) cache_len[c] = 0;
+
+        for (int i = 0; i < srv->nviewers; i++) {
+            Viewer* v = &srv->viewers[i];
+
+            // Only queue a new frame once the previous one is out
+            if (srv->frame < 0 || v->sent == srv->frame || v->out_len > 0)
+                continue;
+
+            // The stream is ordered, so a keyframe is as good as acked
+            long base = v->acked > v->key ? v->acked : v->key;
+            if (base >= 0 && srv->frame - base >= STREAM_HISTORY) base = -1;
+            int slot = base < 0 ? STREAM_HISTORY : srv->frame - base;
+            if (cache_len[slot] == 0)
+                cache_len[slot] = build_message(srv, base, cache[slot]);
+
+            memcpy(v->out, cache[slot], cache_len[slot]);
+            v->out_len = cache_len[slot];
+            v->sent = srv->frame;
+            srv->messages++;
+            if (base < 0) {
+                srv->keyframes++;
+                v->key = srv->frame;
+            }
+            if (!flush_viewer(srv, v)) {
+                close(v->fd);
+                srv->viewers[i--] = srv->viewers[--srv->nviewers];
+            }
+        }
+    }
+
+    srv->cpu = seconds(CLOCK_THREAD_CPUTIME_ID);
+    srv->wall = seconds(CLOCK_MONOTONIC) - wall;
+    return NULL;
+}
+
+// Start streaming server on localhost port or unix:<path>
+StreamServer* open_stream_server(const char* addr) {
+
+    StreamServer* srv = calloc(1, sizeof(StreamServer));
+    if (srv == NULL) return NULL;
+
+    srv->viewers = calloc(STREAM_MAX_VIEWERS, sizeof(Viewer));
+    srv->fds = calloc(STREAM_MAX_VIEWERS + 2, sizeof(struct pollfd));
+    srv->listen_fd = listen_socket(addr, 128);
+    srv->frame = -1;
+    atomic_init(&srv->seq, 0);
+    atomic_init(&srv->stop, false);
+
+    bool woken = pipe(srv->wake) == 0;
+    if (!woken) srv->wake[0] = srv->wake[1] = -1;
+
+    if (srv->viewers == NULL || srv->fds == NULL || srv->listen_fd < 0
+        || !woken || !set_nonblocking(srv->wake[0])
+        || !set_nonblocking(srv->wake[1])
+        || pthread_create(&srv->thread, NULL, server_main, srv) != 0) {
+        if (srv->listen_fd >= 0) close(srv->listen_fd);
+        if (woken) {
+            close(srv->wake[0]);
+            close(srv->wake[1]);
+        }
+        free(srv->fds);
+        free(srv->viewers);
+        free(srv);
+        return NULL;
+    }
+    return srv;
+}
+
+// Publish completed frame, called from send_clock(). Never blocks
+void stream_frame(StreamServer* srv, const Chip8* chip) {
+
+    uint8_t packed[STREAM_FRAME_SIZE];
+    pack_frame(&chip->vid, packed);
+    if (memcmp(packed, srv->last, sizeof(packed)) == 0
+        && atomic_load_explicit(&srv->seq, memory_order_relaxed) != 0)
+        return;
+    memcpy(srv->last, packed, sizeof(packed));
+
+    // Seqlock write, reader retries on odd or changed sequence
+    unsigned s = atomic_load_explicit(&srv->seq, memory_order_relaxed);
+    atomic_store_explicit(&srv->seq, s + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(srv->latest, packed, sizeof(packed));
+    atomic_store_explicit(&srv->seq, s + 2, memory_order_release);
+    wake_server(srv);
+}
+
+// Stop server, disconnect viewers and report statistics
+void close_stream_server(StreamServer* srv) {
+
+    atomic_store(&srv->stop, true);
+    wake_server(srv);
+    pthread_join(srv->thread, NULL);
+
+    for (int i = 0; i < srv->nviewers; i++) close(srv->viewers[i].fd);
+    close(srv->listen_fd);
+    close(srv->wake[0]);
+    close(srv->wake[1]);
+
+    double wall = srv->wall > 0 ? srv->wall : 1;
+    printf("stream: %ld frames, %ld peak viewers, %ld messages "
+           "(%ld keyframes)\n", srv->frame + 1, srv->peak_viewers,
+           srv->messages, srv->keyframes);
+    printf("stream: %.1f kB/s total, %.3f kB/s per viewer, "
+           "server cpu %.1f%%\n", srv->bytes / wall / 1e3,
+           srv->peak_viewers ? srv->bytes / wall / 1e3 / srv->peak_viewers : 0,
+           100 * srv->cpu / wall);
+
+    free(srv->fds);
+    free(srv->viewers);
+    free(srv);
+}
@@ -0,0 +1,77 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdatomic.h>
+#include <pthread.h>
+#include <poll.h>
+
+#include "chip8.h"
+
+#define STREAM_FRAME_SIZE   (SCREEN_WIDTH * SCREEN_HEIGHT / 8) // Packed bits
+#define STREAM_MAX_PAYLOAD  (STREAM_FRAME_SIZE + STREAM_FRAME_SIZE / 64 + 2)
+#define STREAM_HISTORY      (32)        // Frames kept for delta bases
+#define STREAM_MAX_VIEWERS  (4096)
+#define STREAM_WAIT_MS      (100)       // Longest poll without a wake up
+
+// Message types, server to viewer
+#define STREAM_KEYFRAME     (1)         // Payload is the whole frame
+#define STREAM_DELTA        (2)         // Payload is XOR against base frame
+
+// Server to viewer messages are a little endian header followed by the
+// RLE payload: type (1 byte), frame (4), base frame (4), payload length (2).
+// Viewers reply with the little endian uint32_t frame number they now have.
+#define STREAM_HEADER_SIZE  (11)
+#define STREAM_OUT_SIZE     (STREAM_HEADER_SIZE + STREAM_MAX_PAYLOAD)
+
+// A viewer's pending output holds one whole message
+_Static_assert(STREAM_OUT_SIZE >= STREAM_HEADER_SIZE + STREAM_MAX_PAYLOAD,
+               "viewer output buffer smaller than a keyframe message");
+
+typedef struct Viewer {
+    int fd;
+    long acked;             // Last frame viewer has, -1 for none
+    long sent;              // Last frame queued for viewer
+    long key;               // Last keyframe queued for viewer, -1 for none
+    uint8_t out[STREAM_OUT_SIZE];
+    int out_len;
+    uint8_t in[4];          // Partial acknowledgement
+    int in_len;
+} Viewer;
+
+typedef struct StreamServer {
+
+    int listen_fd;
+    int wake[2];            // Pipe waking the server on new frames and stop
+    pthread_t thread;
+    atomic_bool stop;
+
+    // Latest frame, published by the emulation thread under a seqlock
+    atomic_uint seq;
+    uint8_t latest[STREAM_FRAME_SIZE];
+    uint8_t last[STREAM_FRAME_SIZE];    // Emulation side copy for dedup
+
+    // Server thread state
+    uint8_t history[STREAM_HISTORY][STREAM_FRAME_SIZE];
+    long frame;                         // Newest frame number
+    Viewer* viewers;
+    int nviewers;
+    struct pollfd* fds;                 // Listener, wake pipe, then viewers
+
+    // Statistics
+    long peak_viewers;
+    long messages;
+    long keyframes;
+    long bytes;
+    double cpu;                         // Server thread cpu seconds
+    double wall;                        // Server thread wall seconds
+
+} StreamServer;
+
+int rle_encode(const uint8_t* in, int len, uint8_t* out);
+int rle_xor_decode(const uint8_t* in, int len, uint8_t* frame, int size);
+
+StreamServer* open_stream_server(const char* addr);  // Port or unix:<path>
+void stream_frame(StreamServer* srv, const Chip8* chip);
+void close_stream_server(StreamServer* srv);
+
+#endif  // STREAM_H
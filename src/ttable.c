@@ -0,0 +1,121 @@
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "ttable.h"
+#include "hash.h"
+
+// Copy architectural state out of VM
+void save_snapshot(Snapshot* s, const Chip8* chip) {
+    s->pc = chip->pc;
+    s->i = chip->i;
+    memcpy(s->reg, chip->reg, sizeof(s->reg));
+    s->sp = chip->sp;
+    memcpy(s->stack, chip->stack, sizeof(s->stack));
+    s->delay = chip->delay;
+    s->sound = chip->sound;
+    s->rng = chip->rng;
+    s->vblank_wait = chip->vblank_wait;
+    memcpy(s->ram, chip->ram, sizeof(s->ram));
+    s->vid = chip->vid;
+    s->planes = chip->planes;
+    memcpy(s->rpl, chip->rpl, sizeof(s->rpl));
+    memcpy(s->pattern, chip->pattern, sizeof(s->pattern));
+    s->pitch = chip->pitch;
+    s->hash = chip->hash;
+    memcpy(s->vid_hash, chip->vid_hash, sizeof(s->vid_hash));
+}
+
+// Copy architectural state into VM
+void load_snapshot(Chip8* chip, const Snapshot* s) {
+    chip->pc = s->pc;
+    chip->i = s->i;
+    memcpy(chip->reg, s->reg, sizeof(s->reg));
+    chip->sp = s->sp;
+    memcpy(chip->stack, s->stack, sizeof(s->stack));
+    chip->delay = s->delay;
+    chip->sound = s->sound;
+    chip->rng = s->rng;
+    chip->vblank_wait = s->vblank_wait;
+    memcpy(chip->ram, s->ram, sizeof(s->ram));
+    chip->vid = s->vid;
+    chip->planes = s->planes;
+    memcpy(chip->rpl, s->rpl, sizeof(s->rpl));
+    memcpy(chip->pattern, s->pattern, sizeof(s->pattern));
+    chip->pitch = s->pitch;
+    chip->hash = s->hash;
+    memcpy(chip->vid_hash, s->vid_hash, sizeof(s->vid_hash));
+}
+
+// Allocate empty table with 2^bits entries
+TTable* open_ttable(int bits) {
+
+    assert(bits > 0 && bits < 32 && "Invalid table size!");
+
+    TTable* tt = calloc(1, sizeof(TTable));
+    assert(tt != NULL && "Unable to allocate table!");
+    tt->mask = (1u << bits) - 1;
+    tt->entries = calloc((size_t)tt->mask + 1, sizeof(TEntry));
+    assert(tt->entries != NULL && "Unable to allocate table!");
+
+    return tt;
+}
+
+// Run one frame, reusing the cached result if this state was seen before
+void tt_run_frame(TTable* tt, Chip8* chip) {
+
+    if (chip->state != STATE_RUNNING) return;
+
+    // Breakpoints have to see every instruction, snapshots hold 4K, sound
+    // edges have to be generated and key events land mid frame
+    if (chip->exec != cycle || chip->ram_mask != RAM_MASK
+        || chip->audio != NULL || chip->input != NULL) {
+        run_frame(chip);
+        return;
+    }
+
+    // Hashes are only kept once a table runs the machine
+    if (!chip->hashing) start_hashing(chip);
+
+    // The keypad is part of the state hash. The budget differs between
+    // frames when the cycle rate is not a multiple of the clock rate
+    long budget = (long)((chip->clocks + 1) * chip->cycle_f / chip->clock_f)
+                - chip->cycles;
+    uint64_t key = state_hash(chip) ^ (uint64_t)budget * 0x9e3779b97f4a7c15ull;
+    TEntry* e = &tt->entries[key & tt->mask];
+
+    tt->lookups++;
+    if (e->used && e->key == key) {
+        load_snapshot(chip, &e->after);
+        chip->cycles += e->cycles;
+        chip->yielded += e->yielded;
+        chip->frame_exec += e->cycles - e->yielded;
+        chip->frame_yield += e->yielded;
+        tt->hits++;
+        tt->saved += e->cycles;
+
+        // Counters and outputs still see every frame
+        end_frame(chip);
+        chip->clocks++;
+        return;
+    }
+
+    long start = chip->cycles;
+    long yielded = chip->yielded;
+    run_frame(chip);
+
+    // Only whole frames are cached
+    if (chip->state != STATE_RUNNING) return;
+    e->key = key;
+    e->used = true;
+    e->cycles = chip->cycles - start;
+    e->yielded = chip->yielded - yielded;
+    save_snapshot(&e->after, chip);
+    tt->stores++;
+}
+
+// Free table
+void close_ttable(TTable* tt) {
+    free(tt->entries);
+    free(tt);
+}
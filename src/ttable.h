@@ -0,0 +1,56 @@
+#ifndef TTABLE_H
+#define TTABLE_H
+
+#include "chip8.h"
+
+// Architectural state, everything that determines the next frame. Covers 4K
+// memory, the table is bypassed for XO-CHIP
+typedef struct Snapshot {
+    uint16_t pc;
+    uint16_t i;
+    uint8_t  reg[16];
+    uint8_t  sp;
+    uint16_t stack[16];
+    uint8_t  delay;
+    uint8_t  sound;
+    uint32_t rng;
+    bool     vblank_wait;
+    uint8_t  ram[RAM_SIZE + RAM_GUARD];
+    Frame    vid;
+    uint8_t  planes;
+    uint8_t  rpl[16];
+    uint8_t  pattern[16];
+    uint8_t  pitch;
+    uint64_t hash;
+    uint64_t vid_hash[VID_PLANES];
+} Snapshot;
+
+// Cached result of running one frame from a state
+typedef struct TEntry {
+    uint64_t key;           // State hash mixed with input and cycle budget
+    bool used;
+    long cycles;            // Cycles the frame took
+    long yielded;           // Of those, cycles yielded to vblank
+    Snapshot after;         // State at the end of the frame
+} TEntry;
+
+// Direct mapped table, newer entries replace older ones
+typedef struct TTable {
+    TEntry* entries;
+    uint32_t mask;          // Number of entries - 1
+
+    // Statistics
+    long lookups;
+    long hits;
+    long stores;
+    long saved;             // Cycles not executed thanks to hits
+} TTable;
+
+void save_snapshot(Snapshot* s, const Chip8* chip);
+void load_snapshot(Chip8* chip, const Snapshot* s);
+
+TTable* open_ttable(int bits);              // Table with 2^bits entries
+void tt_run_frame(TTable* tt, Chip8* chip); // run_frame() through the table
+void close_ttable(TTable* tt);
+
+#endif  // TTABLE_H
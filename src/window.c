@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "display.h"
+#include "debug.h"
+#include "debug_server.h"
+#include "audio.h"
+#include "input.h"
+#include "metrics.h"
+
+// Draw window, timing it if metrics are exported
+static void render(Chip8* chip) {
+    if (chip->metrics == NULL) {
+        update_display(chip);
+        return;
+    }
+    double start = metrics_now();
+    int draws = update_display(chip);
+    metrics_render(chip->metrics, metrics_now() - start, draws);
+}
+
+// Core execution loop
+void loop(Chip8* chip, ChipState state) {
+
+    // Panels open on request, or straight away when stepping
+    init_display(chip->debug_ui);
+    if (state == STATE_STEPPING) show_panels(true);
+
+    clock_t start = clock();
+    long last_frame = -1;
+    chip->state = state;
+    while (display_is_open()) {
+        if (chip->server != NULL && chip->server->killed) break;
+
+        float delta_t = (clock() - start) / (float)CLOCKS_PER_SEC;
+        if (chip->input != NULL) {
+            if (chip->input->clock == INPUT_WALL) read_key_events(chip->input);
+            apply_input_now(chip->input, chip);
+        }
+
+        // Service debug client once per frame
+        long frame = delta_t * chip->clock_f;
+        if (chip->server != NULL && frame != last_frame) {
+            ChipState prev = chip->state;
+            poll_debug_server(chip->server, chip);
+            last_frame = frame;
+            if (chip->state != prev && chip->state != STATE_HALTED) {
+                chip->cycles = 0;
+                chip->clocks = 0;
+                start = clock();
+                last_frame = 0;
+            }
+        }
+
+        switch (chip->state) {
+        case STATE_RUNNING: {
+            if (chip->cycles <= delta_t * chip->cycle_f) {
+                // Idle out the frame after a draw
+                if (chip->vblank_wait) {
+                    chip->yielded++;
+                    chip->frame_yield++;
+                } else {
+                    chip->exec(chip);
+                    chip->frame_exec++;
+                }
+                chip->cycles++;
+                if (chip->audio != NULL) sync_audio(chip->audio, chip);
+            }
+
+            if (chip->clocks <= delta_t * chip->clock_f) {
+                send_clock(chip);
+                render(chip);
+                chip->clocks++;
+            }
+            break;
+        }
+        case STATE_STEPPING: {
+            // Update display and clock at 60fps
+            if (chip->clocks <= delta_t * chip->clock_f) {
+
+                // Step forward when space is pressed
+                if (is_space_pressed()) {
+                    cycle(chip);
+                    chip->cycles++;
+                }
+                send_clock(chip);
+                render(chip);
+                chip->clocks++;
+            }
+            break;
+        }
+        case STATE_HALTED:
+            // Update display at 60fps
+            if (chip->clocks <= delta_t * chip->clock_f) {
+                render(chip);
+            }
+            break;
+        }
+
+        // Toggle breakpoints by clicking in the RAM panel
+        int addr = get_ram_click();
+        if (addr >= 0) toggle_breakpoint(chip, addr);
+
+        // Each Frame, check for state changes from pressing p, s, r. Tab
+        // shows and hides the panels, pausing or stepping shows them
+        if (is_tab_pressed()) show_panels(!panels_shown());
+        if (is_p_pressed()) {
+            chip->state = STATE_HALTED;
+            show_panels(true);
+        }
+        if (is_space_pressed()) {
+            show_panels(true);
+            if (chip->state != STATE_STEPPING) {
+                chip->cycles = 0;
+                chip->clocks = 0;
+                start = clock();
+            }
+            chip->state = STATE_STEPPING;
+        }
+        if (is_enter_pressed()) {
+            if (chip->state != STATE_RUNNING) {
+                chip->cycles = 0;
+                chip->clocks = 0;
+                start = clock();
+                skip_breakpoint(chip);
+            }
+            chip->state = STATE_RUNNING;
+        }
+    }
+
+    end_display();
+    printf("fin.\n");
+
+}
+
+// Run loop
+void run(Chip8* chip) {
+    loop(chip, STATE_RUNNING);
+}
+
+// Step through loop
+void step(Chip8* chip) {
+    loop(chip, STATE_STEPPING);
+}
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/chip8.h"
+#include "../src/decode.h"
+#include "../src/analysis.h"
+
+// Read rom file into memory image at the reset vector
+static bool read_rom(uint8_t* mem, const char* path) {
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return false;
+
+    uint16_t p = RESET_VECTOR;
+    while (p < CODE_MAP_SIZE && fread(mem + p, 1, 1, f)) {
+        p++;
+    }
+    fclose(f);
+    return true;
+}
+
+// Address after instruction, wrapped the way cycle() fetches
+static uint16_t next_pc(uint16_t addr) {
+    return (addr + 2) & RAM_MASK;
+}
+
+// Address of skipped-to instruction, wrapped the way se() skips. Modules
+// only run in 4K modes, where F000 is not a long instruction
+static uint16_t skip_pc(uint16_t addr) {
+    return (next_pc(addr) + 2) & RAM_MASK;
+}
+
+// True if addr has a label in the generated code
+static bool is_code(const Analysis* an, uint16_t addr) {
+    return addr < CODE_MAP_SIZE && (an->map[addr] & MAP_CODE);
+}
+
+// Format transfer to a statically known address
+static const char* goto_text(const Analysis* an, uint16_t addr) {
+    static char buf[2][48];
+    static int which = 0;
+    which ^= 1;
+    if (is_code(an, addr)) snprintf(buf[which], 48, "goto L_%03x;", addr);
+    else snprintf(buf[which], 48, "{ chip->pc = 0x%03x; goto out; }", addr);
+    return buf[which];
+}
+
+// Emit transfer to a statically known address
+static void emit_goto(FILE* out, const Analysis* an, uint16_t addr) {
+    fprintf(out, "    %s\n", goto_text(an, addr));
+}
+
+// Emit a conditional skip decided by a helper that moves pc
+static void emit_skip(FILE* out, const Analysis* an, uint16_t addr,
+                      const char* call) {
+    fprintf(out, "    chip->pc = 0x%03x;\n", next_pc(addr));
+    fprintf(out, "    %s;\n", call);
+    fprintf(out, "    if (chip->pc == 0x%03x) %s\n", skip_pc(addr),
+            goto_text(an, skip_pc(addr)));
+    emit_goto(out, an, next_pc(addr));
+}
+
+// Find next translated instruction after addr, the one emitted next
+static uint16_t next_code(const Analysis* an, uint16_t addr) {
+    uint16_t a = addr + 1;
+    while (a < CODE_MAP_SIZE && !(an->map[a] & MAP_CODE)) a++;
+    return a;
+}
+
+// Emit one instruction, mirroring cycle()
+static void emit_op(FILE* out, const Analysis* an, uint16_t addr,
+                    uint16_t opc) {
+
+    uint8_t x = (opc & 0x0f00) >> 8;
+    uint8_t y = (opc & 0x00f0) >> 4;
+    uint8_t n = opc & 0x000f;
+    uint8_t kk = opc & 0x00ff;
+    uint16_t nnn = opc & 0x0fff;
+    char call[64];
+
+    char text[32];
+    disassemble(opc, text, sizeof(text));
+    fprintf(out, "L_%03x: /* %s */\n", addr, text);
+
+    // Waiting for a key and later instruction sets are left to the
+    // interpreter
+    if ((opc & 0xf0ff) == 0xf00a || decode_op(opc)->isa != ISA_CHIP8) {
+        fprintf(out, "    chip->pc = 0x%03x; goto out;\n", addr);
+        return;
+    }
+    fprintf(out, "    if (n == budget) { chip->pc = 0x%03x; goto out; }\n", addr);
+    fprintf(out, "    n++;\n");
+
+    static const char* alu[16] = {
+        "ld", "or", "and", "xor", "add", "sub", "shr", "subn",
+        NULL, NULL, NULL, NULL, NULL, NULL, "shl", NULL,
+    };
+
+    switch (opc >> 12) {
+    case 0x0:
+        if (opc == 0x00e0) {
+            fprintf(out, "    cls(chip);\n");
+        } else {
+            fprintf(out, "    ret(chip);\n");
+            fprintf(out, "    DISPATCH();\n");
+            return;
+        }
+        break;
+    case 0x1:
+        emit_goto(out, an, nnn);
+        return;
+    case 0x2:
+        fprintf(out, "    chip->pc = 0x%03x;\n", next_pc(addr));
+        fprintf(out, "    call(chip, 0x%03x);\n", nnn);
+        emit_goto(out, an, nnn);
+        return;
+    case 0x3:
+        snprintf(call, sizeof(call), "se(chip, %d, %d)", x, kk);
+        emit_skip(out, an, addr, call);
+        return;
+    case 0x4:
+        snprintf(call, sizeof(call), "sne(chip, %d, %d)", x, kk);
+        emit_skip(out, an, addr, call);
+        return;
+    case 0x5:
+        snprintf(call, sizeof(call), "se(chip, %d, chip->reg[%d])", x, y);
+        emit_skip(out, an, addr, call);
+        return;
+    case 0x6:
+        fprintf(out, "    ld(chip, %d, %d);\n", x, kk);
+        break;
+    case 0x7:
+        fprintf(out, "    addnc(chip, %d, %d);\n", x, kk);
+        break;
+    case 0x8:
+        fprintf(out, "    %s(chip, %d, chip->reg[%d]);\n", alu[n], x, y);
+        break;
+    case 0x9:
+        snprintf(call, sizeof(call), "sne(chip, %d, chip->reg[%d])", x, y);
+        emit_skip(out, an, addr, call);
+        return;
+    case 0xa:
+        fprintf(out, "    ldi(chip, 0x%03x);\n", nnn);
+        break;
+    case 0xb:
+        fprintf(out, "    jp(chip, 0x%03x + chip->reg[chip->quirk_jump ? %d : 0]);\n",
+                nnn, x);
+        fprintf(out, "    DISPATCH();\n");
+        return;
+    case 0xc:
+        fprintf(out, "    rnd(chip, %d, %d);\n", x, kk);
+        break;
+    case 0xd:
+        fprintf(out, "    drw(chip, %d, %d, %d);\n", x, y, n);
+        fprintf(out, "    if (chip->vblank_wait) { chip->pc = 0x%03x; goto out; }\n",
+                next_pc(addr));
+        break;
+    case 0xe:
+        snprintf(call, sizeof(call), "%s(chip, chip->reg[%d])",
+                 kk == 0x9e ? "skp" : "sknp", x);
+        emit_skip(out, an, addr, call);
+        return;
+    case 0xf:
+        switch (kk) {
+        case 0x07: fprintf(out, "    ld(chip, %d, chip->delay);\n", x); break;
+        case 0x15: fprintf(out, "    ldd(chip, chip->reg[%d]);\n", x);  break;
+        case 0x18: fprintf(out, "    lds(chip, chip->reg[%d]);\n", x);  break;
+        case 0x1e: fprintf(out, "    addi(chip, chip->reg[%d]);\n", x); break;
+        case 0x29: fprintf(out, "    ld_sprite(chip, chip->reg[%d]);\n", x);
+                   break;
+        case 0x65: fprintf(out, "    ldr(chip, %d);\n", x);             break;
+        case 0x33:
+        case 0x55:
+            // Writes that land on translated code end translation for good,
+            // set_ram() drops chip->aot
+            if (kk == 0x33) fprintf(out, "    ld_bcd(chip, chip->reg[%d]);\n", x);
+            else fprintf(out, "    str(chip, %d);\n", x);
+            fprintf(out, "    if (chip->aot == NULL) { chip->pc = 0x%03x; goto out; }\n",
+                    next_pc(addr));
+            break;
+        }
+        break;
+    }
+
+    // Straight line code falls through to the next emitted instruction
+    if (next_code(an, addr) != next_pc(addr))
+        emit_goto(out, an, next_pc(addr));
+}
+
+// Emit code map, the interpreter drops the module when one is written
+static void emit_code_map(FILE* out, const Analysis* an) {
+
+    fprintf(out, "static const uint8_t code_map[0x1000] = {\n");
+    for (uint16_t a = 0; a < CODE_MAP_SIZE; a++) {
+        if (an->map[a] & (MAP_CODE | MAP_OPERAND))
+            fprintf(out, "    [0x%03x] = 1,\n", a);
+    }
+    fprintf(out, "};\n\n");
+}
+
+// Emit C module for analysed rom
+static void emit_module(FILE* out, const Analysis* an, const uint8_t* mem,
+                        const char* rom) {
+
+    // Rom path as a C string
+    char name[1024];
+    size_t len = 0;
+    for (const char* c = rom; *c && len + 2 < sizeof(name); c++) {
+        if (*c == '"' || *c == '\\') name[len++] = '\\';
+        name[len++] = *c;
+    }
+    name[len] = '\0';
+
+    fprintf(out, "// Generated by chip8-aot from %s, do not edit\n\n", name);
+    fprintf(out, "#pragma GCC diagnostic ignored \"-Wpedantic\"\n\n");
+    fprintf(out, "#include \"chip8.h\"\n");
+    fprintf(out, "#include \"opcodes.h\"\n");
+    fprintf(out, "#include \"aot.h\"\n\n");
+
+    // Code map for self-modification checks
+    emit_code_map(out, an);
+
+    fprintf(out, "// Run up to budget instructions, returns instructions run\n");
+    fprintf(out, "static long aot_run(Chip8* chip, long budget) {\n\n");
+    fprintf(out, "    static void* const dispatch[0x1000] = {\n");
+    for (uint16_t a = 0; a < CODE_MAP_SIZE; a++) {
+        if (an->map[a] & MAP_CODE)
+            fprintf(out, "        [0x%03x] = &&L_%03x,\n", a, a);
+    }
+    fprintf(out, "    };\n\n");
+    fprintf(out, "#define DISPATCH() \\\n");
+    fprintf(out, "    do { if (chip->pc < 0x1000 && dispatch[chip->pc]) \\\n");
+    fprintf(out, "             goto *dispatch[chip->pc]; \\\n");
+    fprintf(out, "         goto out; } while (0)\n\n");
+    fprintf(out, "    long n = 0;\n");
+    fprintf(out, "    DISPATCH();\n\n");
+
+    for (uint16_t a = 0; a < CODE_MAP_SIZE; a++) {
+        if (!(an->map[a] & MAP_CODE)) continue;
+        if (an->map[a] & MAP_LEADER) fprintf(out, "\n");
+        emit_op(out, an, a, (mem[a] << 8) + mem[(a + 1) & RAM_MASK]);
+    }
+
+    fprintf(out, "\nout:\n");
+    fprintf(out, "    return n;\n");
+    fprintf(out, "#undef DISPATCH\n");
+    fprintf(out, "}\n\n");
+
+    fprintf(out, "const AotModule aot_module = {\n");
+    fprintf(out, "    .rom = \"%s\",\n", name);
+    fprintf(out, "    .rom_hash = 0x%08x,\n", an->rom_hash);
+    fprintf(out, "    .run = aot_run,\n");
+    fprintf(out, "    .code_map = code_map,\n");
+    fprintf(out, "};\n");
+}
+
+int main(int argc, char** argv) {
+
+    const char* rom = NULL;
+    const char* path = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) path = argv[++i];
+        else rom = argv[i];
+    }
+
+    if (rom == NULL) {
+        printf("Usage: chip8-aot <path_to_rom> [-o <module.c>]\n");
+        return 1;
+    }
+
+    static uint8_t mem[CODE_MAP_SIZE];
+    if (!read_rom(mem, rom)) {
+        printf("Unable to open ROM file %s\n", rom);
+        return 1;
+    }
+
+    static Analysis an;
+    analyse(&an, mem);
+
+    FILE* out = path != NULL ? fopen(path, "w") : stdout;
+    if (out == NULL) {
+        printf("Unable to write %s\n", path);
+        return 1;
+    }
+    emit_module(out, &an, mem, rom);
+    if (out != stdout) fclose(out);
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/chip8.h"
+#include "../src/aot.h"
+
+// Provided by the module chip8-aot generated for this build
+extern const AotModule aot_module;
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Set up VM for a benchmark run
+static Chip8* make_chip(const char* rom, long per_frame) {
+    Chip8* chip = calloc(1, sizeof(Chip8));
+    init_chip8(chip);
+    load_rom(chip, rom);
+    chip->trace = false;
+    chip->cycle_f = chip->clock_f * per_frame;
+    chip->state = STATE_RUNNING;
+    return chip;
+}
+
+// Run frames, returns seconds taken
+static double run_frames(Chip8* chip, long frames) {
+    double start = now();
+    for (long f = 0; f < frames && chip->state == STATE_RUNNING; f++)
+        run_frame(chip);
+    return now() - start;
+}
+
+// Compare architectural state of two VMs
+static bool same_state(const Chip8* a, const Chip8* b) {
+    return a->pc == b->pc && a->i == b->i && a->sp == b->sp
+        && a->delay == b->delay && a->sound == b->sound
+        && memcmp(a->reg, b->reg, sizeof(a->reg)) == 0
+        && memcmp(a->stack, b->stack, sizeof(a->stack)) == 0
+        && memcmp(a->ram, b->ram, sizeof(a->ram)) == 0
+        && memcmp(&a->vid, &b->vid, sizeof(a->vid)) == 0;
+}
+
+int main(int argc, char** argv) {
+
+    const char* rom = argc > 1 ? argv[1] : aot_module.rom;
+    long frames = argc > 2 ? atol(argv[2]) : 1000;
+    long per_frame = argc > 3 ? atol(argv[3]) : 10000;
+
+    Chip8* interp = make_chip(rom, per_frame);
+    Chip8* aot = make_chip(rom, per_frame);
+    if (!attach_aot(aot, &aot_module)) {
+        printf("%s does not match the rom the module was built from (%s)\n",
+               rom, aot_module.rom);
+        return 1;
+    }
+
+    double t_interp = run_frames(interp, frames);
+    double t_aot = run_frames(aot, frames);
+
+    printf("%s: %ld frames of %ld instructions, %ld yielded to vblank\n",
+           rom, frames, per_frame, interp->yielded);
+    printf("  interpreter: %8.3fs %8.1f M instructions/s\n", t_interp,
+           (interp->cycles - interp->yielded) / t_interp / 1e6);
+    printf("  aot:         %8.3fs %8.1f M instructions/s (%.1fx)%s\n", t_aot,
+           (aot->cycles - aot->yielded) / t_aot / 1e6, t_interp / t_aot,
+           aot->aot == NULL ? ", fell back to interpreter" : "");
+    printf("  final state: %s\n", same_state(interp, aot) ? "match" : "MISMATCH");
+
+    return same_state(interp, aot) ? 0 : 1;
+}
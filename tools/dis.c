@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/chip8.h"
+#include "../src/decode.h"
+#include "../src/analysis.h"
+
+// Read rom file into memory image at the reset vector
+static bool read_rom(uint8_t* mem, const char* path) {
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) return false;
+
+    uint16_t p = RESET_VECTOR;
+    while (p < CODE_MAP_SIZE && fread(mem + p, 1, 1, f)) {
+        p++;
+    }
+    fclose(f);
+    return true;
+}
+
+// Print listing, code as instructions and everything else as data
+static void print_listing(const Analysis* an, const uint8_t* mem) {
+
+    uint16_t a = RESET_VECTOR;
+    while (a < CODE_MAP_SIZE) {
+        uint8_t m = an->map[a];
+
+        if (m & MAP_LEADER && m & MAP_CODE) {
+            printf("\n%s_%03x:\n", m & MAP_CALLED ? "sub" : "block", a);
+        }
+
+        if (m & MAP_CODE) {
+            char text[32];
+            uint16_t opc = (mem[a] << 8) + mem[a + 1];
+            disassemble(opc, text, sizeof(text));
+            if (op_length(opc) == 4 && a + 3 < CODE_MAP_SIZE) {
+                // Long form carries its operand in the next word
+                uint16_t word = (mem[a + 2] << 8) + mem[a + 3];
+                printf("  0x%03x: %04x  %s 0x%04x\n", a, opc, text, word);
+                a += 4;
+                continue;
+            }
+            printf("  0x%03x: %04x  %s\n", a, opc, text);
+            a += 2;
+            continue;
+        }
+
+        // Group consecutive data bytes, skip trailing zero fill
+        uint16_t end = a;
+        while (end < CODE_MAP_SIZE && !(an->map[end] & MAP_CODE)
+               && end - a < 8) end++;
+        bool zeros = true;
+        for (uint16_t z = a; z < CODE_MAP_SIZE && zeros; z++) {
+            if (an->map[z] & MAP_CODE || mem[z] != 0) zeros = false;
+        }
+        if (zeros) break;
+
+        printf("  0x%03x: db   ", a);
+        for (uint16_t d = a; d < end; d++) printf(" 0x%02x", mem[d]);
+        printf("\n");
+        a = end;
+    }
+}
+
+// Print control flow graph in graphviz format
+static void print_dot(const Analysis* an) {
+
+    printf("digraph cfg {\n");
+    printf("  node [shape=box];\n");
+    for (uint16_t i = 0; i < an->nblocks; i++) {
+        const Block* b = &an->blocks[i];
+        printf("  b%03x [label=\"0x%03x-0x%03x%s%s\"];\n", b->start,
+               b->start, b->end - 2,
+               b->flags & BLOCK_RET ? " ret" : "",
+               b->flags & BLOCK_INDIRECT ? " jp v0" : "");
+        for (uint8_t s = 0; s < b->nsucc; s++) {
+            const char* style = "";
+            if (b->flags & BLOCK_CALL) style = s == 0 ? " [label=call]"
+                                                      : " [style=dashed]";
+            printf("  b%03x -> b%03x%s;\n", b->start, b->succ[s], style);
+        }
+    }
+    printf("}\n");
+}
+
+int main(int argc, char** argv) {
+
+    const char* rom = NULL;
+    const char* out = NULL;
+    bool dot = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dot") == 0) dot = true;
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) out = argv[++i];
+        else rom = argv[i];
+    }
+
+    if (rom == NULL) {
+        printf("Usage: chip8-dis <path_to_rom> [-o <analysis>] [--dot]\n");
+        return 1;
+    }
+
+    static uint8_t mem[CODE_MAP_SIZE];
+    if (!read_rom(mem, rom)) {
+        printf("Unable to open ROM file %s\n", rom);
+        return 1;
+    }
+
+    static Analysis an;
+    analyse(&an, mem);
+
+    if (dot) print_dot(&an);
+    else print_listing(&an, mem);
+
+    // Cache analysis next to the rom unless told otherwise
+    char cache[1024];
+    if (out == NULL) {
+        snprintf(cache, sizeof(cache), "%s" ANALYSIS_EXT, rom);
+        out = cache;
+    }
+    if (!save_analysis(&an, out)) {
+        printf("Unable to write analysis to %s\n", out);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/chip8.h"
+#include "../src/opcodes.h"
+
+// Times the 128 bit row framebuffer against a byte per pixel one on the
+// SUPER-CHIP scroll and 16x16 sprite ops, then runs a scroll heavy rom
+
+#define OPS         (200000L)
+#define RUNS        (5)
+#define FRAMES      (1000)
+#define PER_FRAME   (10000L)
+
+// Example rom when none is given: draws a 16x16 sprite at a random spot in
+// hires, then scrolls down, left, up and right, forever
+static const uint8_t scroller[] = {
+    0x00, 0xff,     // 0x200: high
+    0xa2, 0x16,     // 0x202: ld   i, 0x216
+    0xc0, 0x7f,     // 0x204: rnd  v0, 127
+    0xc1, 0x3f,     // 0x206: rnd  v1, 63
+    0xd0, 0x10,     // 0x208: drw  v0, v1, 16x16
+    0x00, 0xc1,     // 0x20a: scd  1
+    0x00, 0xfc,     // 0x20c: scl
+    0x00, 0xd1,     // 0x20e: scu  1
+    0x00, 0xfb,     // 0x210: scr
+    0x12, 0x04,     // 0x212: jp   0x204
+    0x00, 0x00,
+    0xff, 0xff, 0x80, 0x01, 0xbf, 0xfd, 0xa0, 0x05, // 0x216: sprite
+    0xaf, 0xf5, 0xa8, 0x15, 0xab, 0xd5, 0xaa, 0x55,
+    0xaa, 0x55, 0xab, 0xd5, 0xa8, 0x15, 0xaf, 0xf5,
+    0xa0, 0x05, 0xbf, 0xfd, 0x80, 0x01, 0xff, 0xff,
+};
+
+// Byte per pixel framebuffer, the layout the rows replaced
+static uint8_t px[HIRES_HEIGHT][HIRES_WIDTH];
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Byte per pixel scroll down n rows
+static void px_scd(int n) {
+    memmove(px[n], px[0], (HIRES_HEIGHT - n) * HIRES_WIDTH);
+    memset(px[0], 0, n * HIRES_WIDTH);
+}
+
+// Byte per pixel scroll up n rows
+static void px_scu(int n) {
+    memmove(px[0], px[n], (HIRES_HEIGHT - n) * HIRES_WIDTH);
+    memset(px[HIRES_HEIGHT - n], 0, n * HIRES_WIDTH);
+}
+
+// Byte per pixel scroll right 4 pixels
+static void px_scr(void) {
+    for (int y = 0; y < HIRES_HEIGHT; y++) {
+        memmove(&px[y][4], &px[y][0], HIRES_WIDTH - 4);
+        memset(&px[y][0], 0, 4);
+    }
+}
+
+// Byte per pixel scroll left 4 pixels
+static void px_scl(void) {
+    for (int y = 0; y < HIRES_HEIGHT; y++) {
+        memmove(&px[y][0], &px[y][4], HIRES_WIDTH - 4);
+        memset(&px[y][HIRES_WIDTH - 4], 0, 4);
+    }
+}
+
+// Byte per pixel 16x16 sprite, clipped, returns collision
+static uint8_t px_drw(const uint8_t* sprite, int x, int y) {
+    uint8_t flag = 0;
+    for (int j = 0; j < 16 && y + j < HIRES_HEIGHT; j++) {
+        uint16_t bitmap = (sprite[2 * j] << 8) + sprite[2 * j + 1];
+        for (int k = 0; k < 16 && x + k < HIRES_WIDTH; k++) {
+            uint8_t bit = (bitmap >> (15 - k)) & 1;
+            flag |= px[y + j][x + k] & bit;
+            px[y + j][x + k] ^= bit;
+        }
+    }
+    return flag;
+}
+
+// Keeps the compiler from dropping the loops
+static volatile uint32_t sink;
+
+// One op from each group, against the byte per pixel layout
+static uint32_t run_bytes(Chip8* chip, long ops) {
+    uint32_t sum = 0;
+    const uint8_t* sprite = &chip->ram[0x300];
+    for (long s = 0; s < ops; s++) {
+        switch (s & 7) {
+        case 0: px_scd(1 + (s & 0xf) % 15); break;
+        case 1: px_scl();                   break;
+        case 2: px_scu(1 + (s & 0xf) % 15); break;
+        case 3: px_scr();                   break;
+        default: sum += px_drw(sprite, (s * 7) & 0x7f, (s * 3) & 0x3f);
+        }
+    }
+    return sum + px[0][0];
+}
+
+// The same ops on the row framebuffer, through the opcode handlers
+static uint32_t run_rows(Chip8* chip, long ops) {
+    uint32_t sum = 0;
+    chip->i = 0x300;
+    for (long s = 0; s < ops; s++) {
+        switch (s & 7) {
+        case 0: scd(chip, 1 + (s & 0xf) % 15); break;
+        case 1: scl(chip);                     break;
+        case 2: scu(chip, 1 + (s & 0xf) % 15); break;
+        case 3: scr(chip);                     break;
+        default:
+            chip->reg[0] = (s * 7) & 0x7f;
+            chip->reg[1] = (s * 3) & 0x3f;
+            drw(chip, 0, 1, 0);
+            sum += chip->reg[0xf];
+        }
+    }
+    return sum + get_pixel(&chip->vid, 0, 0);
+}
+
+// Best time of several runs, in ns per op
+static double best(uint32_t (*run)(Chip8*, long), Chip8* chip) {
+    double t = 1e9;
+    for (int r = 0; r < RUNS; r++) {
+        double start = now();
+        sink = run(chip, OPS);
+        double d = now() - start;
+        if (d < t) t = d;
+    }
+    return t / OPS * 1e9;
+}
+
+// Set up SUPER-CHIP VM in hires with rom, or the example
+static Chip8* make_chip(const char* rom) {
+    Chip8* chip = calloc(1, sizeof(Chip8));
+    init_chip8(chip);
+    set_mode(chip, MODE_SCHIP);
+    if (rom != NULL) {
+        load_rom(chip, rom);
+    } else {
+        memcpy(chip->ram + RESET_VECTOR, scroller, sizeof(scroller));
+        mirror_guard(chip);
+    }
+    chip->trace = false;
+    chip->cycle_f = chip->clock_f * PER_FRAME;
+    chip->state = STATE_RUNNING;
+    return chip;
+}
+
+int main(int argc, char** argv) {
+
+    const char* rom = argc > 1 ? argv[1] : NULL;
+
+    // Frame ops, both layouts start from the same 16x16 sprite
+    Chip8* chip = make_chip(NULL);
+    memcpy(&chip->ram[0x300], &scroller[0x16], 32);
+    set_hires(chip, true);
+    double t_bytes = best(run_bytes, chip);
+    double t_rows = best(run_rows, chip);
+
+    printf("%ld scroll and 16x16 sprite ops, best of %d\n", OPS, RUNS);
+    printf("  bytes: %6.2f ns/op\n", t_bytes);
+    printf("  rows:  %6.2f ns/op (%.2fx)\n", t_rows, t_bytes / t_rows);
+    free(chip);
+
+    // Whole interpreter on a scroll heavy rom
+    chip = make_chip(rom);
+    double start = now();
+    for (int f = 0; f < FRAMES && chip->state == STATE_RUNNING; f++)
+        run_frame(chip);
+    double t = now() - start;
+
+    printf("%s: %d frames of %ld instructions\n",
+           rom != NULL ? rom : "scroller example", FRAMES, PER_FRAME);
+    printf("  %.3fs %8.1f M instructions/s\n", t, chip->cycles / t / 1e6);
+    free(chip);
+
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/chip8.h"
+
+// Compares the masked memory model against the modulo arithmetic it
+// replaced. Both run in synthetic loops that mimic the interpreter's access
+// pattern, fetch, skip, and a block access from i of up to 16 bytes (drw,
+// ldr), not in the interpreter, since the modulo model no longer exists
+// there. The real cycle() is timed on random memory for scale
+
+#define OLD_SIZE    (0xfff)
+#define STEPS       (20000000L)
+#define RUNS        (5)
+
+static uint8_t old_ram[OLD_SIZE];
+static uint8_t new_ram[RAM_SIZE + RAM_GUARD];
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Modulo wrap: % 0x0ffe on fetch, % 0xfff on skip, per byte wrap on blocks
+static uint32_t run_modulo(long steps) {
+    uint32_t sum = 0;
+    uint16_t pc = RESET_VECTOR, i = 0;
+    for (long s = 0; s < steps; s++) {
+        uint16_t opc = (old_ram[pc] << 8) + old_ram[(pc + 1) % OLD_SIZE];
+        pc = (pc + 2) % 0x0ffe;
+        pc = (pc + ((opc >> 14) & 2)) % OLD_SIZE;
+        i += opc;
+        for (int k = 0; k <= (opc & 0xf); k++)
+            sum += old_ram[(i + k) % OLD_SIZE];
+    }
+    return sum;
+}
+
+// Masked wrap: & RAM_MASK once, guard bytes cover the rest of the block
+static uint32_t run_masked(long steps) {
+    uint32_t sum = 0;
+    uint16_t pc = RESET_VECTOR, i = 0;
+    for (long s = 0; s < steps; s++) {
+        uint16_t opc = (new_ram[pc] << 8) + new_ram[pc + 1];
+        pc = (pc + 2) & RAM_MASK;
+        pc = (pc + ((opc >> 14) & 2)) & RAM_MASK;
+        i += opc;
+        const uint8_t* block = &new_ram[i & RAM_MASK];
+        for (int k = 0; k <= (opc & 0xf); k++)
+            sum += block[k];
+    }
+    return sum;
+}
+
+// Keeps the compiler from dropping the loops
+static volatile uint32_t sink;
+
+// The interpreter itself, masked model, executing random memory
+static uint32_t run_cycle(long steps) {
+    static Chip8 chip;
+    init_chip8(&chip);
+    memcpy(chip.ram + RESET_VECTOR, new_ram + RESET_VECTOR, RAM_SIZE - RESET_VECTOR);
+    mirror_guard(&chip);
+    chip.trace = false;
+    for (long s = 0; s < steps; s++) {
+        cycle(&chip);
+        chip.vblank_wait = false;
+    }
+    return chip.pc + chip.i;
+}
+
+// Best time of several runs, in ns per step
+static double best(uint32_t (*run)(long)) {
+    double t = 1e9;
+    for (int r = 0; r < RUNS; r++) {
+        double start = now();
+        sink = run(STEPS);
+        double d = now() - start;
+        if (d < t) t = d;
+    }
+    return t / STEPS * 1e9;
+}
+
+int main(void) {
+
+    srand(1);
+    for (int a = 0; a < OLD_SIZE; a++) old_ram[a] = new_ram[a] = rand();
+    for (int a = OLD_SIZE; a < RAM_SIZE; a++) new_ram[a] = rand();
+    for (int a = 0; a < RAM_GUARD; a++) new_ram[RAM_SIZE + a] = new_ram[a];
+
+    double t_mod = best(run_modulo);
+    double t_mask = best(run_masked);
+    double t_cycle = best(run_cycle);
+
+    printf("%ld synthetic steps of fetch, skip and block access, best of %d\n",
+           STEPS, RUNS);
+    printf("  modulo: %6.2f ns/step\n", t_mod);
+    printf("  masked: %6.2f ns/step (%.2fx)\n", t_mask, t_mod / t_mask);
+    printf("%ld cycle() calls on random memory, best of %d\n", STEPS, RUNS);
+    printf("  cycle:  %6.2f ns/instruction\n", t_cycle);
+
+    return 0;
+}
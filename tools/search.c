@@ -0,0 +1,189 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/chip8.h"
+#include "../src/hash.h"
+#include "../src/ttable.h"
+
+#define MAX_INPUTS  (17)
+
+// Example rom when none is given: a dot moved one pixel per frame with
+// keys 5/8/7/9 (up/down/left/right). Different input orders often reach
+// the same position, so the search revisits states
+static const uint8_t walker[] = {
+    0x60, 0x20,     // 0x200: ld   v0, 32
+    0x61, 0x10,     // 0x202: ld   v1, 16
+    0xa2, 0x38,     // 0x204: ld   i, 0x238
+    0xd0, 0x11,     // 0x206: drw  v0, v1, 1
+    0x64, 0x01,     // 0x208: ld   v4, 1
+    0xf4, 0x15,     // 0x20a: ld   dt, v4
+    0xf4, 0x07,     // 0x20c: ld   v4, dt
+    0x34, 0x00,     // 0x20e: se   v4, 0
+    0x12, 0x0c,     // 0x210: jp   0x20c
+    0xd0, 0x11,     // 0x212: drw  v0, v1, 1
+    0x62, 0x05,     // 0x214: ld   v2, 5
+    0xe2, 0xa1,     // 0x216: sknp v2
+    0x71, 0xff,     // 0x218: add  v1, 255
+    0x62, 0x08,     // 0x21a: ld   v2, 8
+    0xe2, 0xa1,     // 0x21c: sknp v2
+    0x71, 0x01,     // 0x21e: add  v1, 1
+    0x62, 0x07,     // 0x220: ld   v2, 7
+    0xe2, 0xa1,     // 0x222: sknp v2
+    0x70, 0xff,     // 0x224: add  v0, 255
+    0x62, 0x09,     // 0x226: ld   v2, 9
+    0xe2, 0xa1,     // 0x228: sknp v2
+    0x70, 0x01,     // 0x22a: add  v0, 1
+    0x63, 0x3f,     // 0x22c: ld   v3, 63
+    0x80, 0x32,     // 0x22e: and  v0, v3
+    0x63, 0x1f,     // 0x230: ld   v3, 31
+    0x81, 0x32,     // 0x232: and  v1, v3
+    0xd0, 0x11,     // 0x234: drw  v0, v1, 1
+    0x12, 0x08,     // 0x236: jp   0x208
+    0x80,           // 0x238: sprite
+};
+
+typedef struct Search {
+    uint16_t inputs[MAX_INPUTS];    // Keypad states tried each frame
+    int ninputs;
+    TTable* tt;                     // Transposition table, if any
+
+    long frames;                    // Frames run, including cached ones
+    long cycles;                    // Cycles covered by those frames
+    long leaves;
+    uint64_t checksum;              // Sum of final state hashes
+} Search;
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Try every input sequence of given depth from the current state
+static void search(Search* s, Chip8* chip, int depth) {
+
+    if (depth == 0 || chip->state != STATE_RUNNING) {
+        s->leaves++;
+        s->checksum += state_hash(chip);
+        return;
+    }
+
+    Snapshot start;
+    save_snapshot(&start, chip);
+    long cycles = chip->cycles;
+    long clocks = chip->clocks;
+
+    for (int k = 0; k < s->ninputs; k++) {
+        chip->keypad = s->inputs[k];
+        if (s->tt != NULL) tt_run_frame(s->tt, chip);
+        else run_frame(chip);
+        s->frames++;
+        s->cycles += chip->cycles - cycles;
+
+        search(s, chip, depth - 1);
+
+        load_snapshot(chip, &start);
+        chip->cycles = cycles;
+        chip->clocks = clocks;
+        chip->state = STATE_RUNNING;
+    }
+}
+
+// Set up VM at the start of the search
+static Chip8* make_chip(const char* rom, long per_frame) {
+    Chip8* chip = calloc(1, sizeof(Chip8));
+    init_chip8(chip);
+    start_hashing(chip);
+    if (rom != NULL) {
+        load_rom(chip, rom);
+    } else {
+        memcpy(chip->ram + RESET_VECTOR, walker, sizeof(walker));
+        rehash_state(chip);
+    }
+    chip->trace = false;
+    chip->cycle_f = chip->clock_f * per_frame;
+    chip->state = STATE_RUNNING;
+    return chip;
+}
+
+// Run search, print statistics, returns seconds taken
+static double run_search(Search* s, const char* rom, long per_frame,
+                         int depth, const char* name) {
+
+    Chip8* chip = make_chip(rom, per_frame);
+    s->frames = s->cycles = s->leaves = 0;
+    s->checksum = 0;
+
+    double start = now();
+    search(s, chip, depth);
+    double t = now() - start;
+
+    long saved = s->tt != NULL ? s->tt->saved : 0;
+    printf("  %-6s %8.3fs %9ld frames %11ld cycles executed", name, t,
+           s->frames, s->cycles - saved);
+    if (s->tt != NULL) {
+        printf(", %.1f%% hits, %ld cycles saved",
+               s->tt->lookups ? 100.0 * s->tt->hits / s->tt->lookups : 0,
+               saved);
+    }
+    printf("\n");
+
+    free(chip);
+    return t;
+}
+
+int main(int argc, char** argv) {
+
+    const char* rom = NULL;
+    const char* keys = "5879";
+    int depth = 6;
+    int bits = 14;
+    long per_frame = 200;
+
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-d") == 0 && a + 1 < argc) {
+            depth = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-k") == 0 && a + 1 < argc) {
+            keys = argv[++a];
+        } else if (strcmp(argv[a], "-b") == 0 && a + 1 < argc) {
+            bits = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-n") == 0 && a + 1 < argc) {
+            per_frame = atol(argv[++a]);
+        } else if (argv[a][0] == '-') {
+            printf("usage: %s [rom] [-d depth] [-k keys] [-b bits] "
+                   "[-n instructions per frame]\n", argv[0]);
+            return 1;
+        } else {
+            rom = argv[a];
+        }
+    }
+
+    // No key pressed, then each key on its own
+    Search s = {0};
+    s.inputs[s.ninputs++] = 0;
+    for (const char* k = keys; *k && s.ninputs < MAX_INPUTS; k++) {
+        char digit[2] = {*k, '\0'};
+        char* end;
+        long key = strtol(digit, &end, 16);
+        if (*end != '\0') continue;
+        s.inputs[s.ninputs++] = 1 << key;
+    }
+
+    printf("%s: %d inputs to depth %d, %ld instructions per frame\n",
+           rom != NULL ? rom : "walker example", s.ninputs, depth, per_frame);
+
+    double t_plain = run_search(&s, rom, per_frame, depth, "plain:");
+    uint64_t checksum = s.checksum;
+
+    s.tt = open_ttable(bits);
+    double t_table = run_search(&s, rom, per_frame, depth, "table:");
+    printf("  %ld leaves, %.1fx faster, results %s\n", s.leaves,
+           t_plain / t_table, s.checksum == checksum ? "match" : "MISMATCH");
+
+    bool ok = s.checksum == checksum;
+    close_ttable(s.tt);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "../src/chip8.h"
+#include "../src/stream.h"
+#include "../src/net.h"
+
+typedef struct Client {
+    int fd;
+    uint8_t buf[STREAM_HEADER_SIZE + STREAM_MAX_PAYLOAD];
+    int len;                                        // Bytes buffered
+    uint8_t frames[STREAM_HISTORY][STREAM_FRAME_SIZE];
+    long numbers[STREAM_HISTORY];                   // Frame in each slot
+    long current;                                   // Newest decoded frame
+    long decoded;
+    long keyframes;
+    long bytes;
+} Client;
+
+// Read little endian integer
+static uint32_t get_le(const uint8_t* p, int n) {
+    uint32_t v = 0;
+    for (int i = n - 1; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+// Seconds on the monotonic clock
+static double now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Decode one message into frame history and acknowledge it
+static bool handle_message(Client* c, const uint8_t* msg) {
+
+    uint8_t type = msg[0];
+    long frame = get_le(msg + 1, 4);
+    long base = get_le(msg + 5, 4);
+    int len = get_le(msg + 9, 2);
+
+    uint8_t next[STREAM_FRAME_SIZE];
+    if (type == STREAM_KEYFRAME) {
+        memset(next, 0, sizeof(next));
+        c->keyframes++;
+    } else if (c->numbers[base % STREAM_HISTORY] == base) {
+        memcpy(next, c->frames[base % STREAM_HISTORY], sizeof(next));
+    } else {
+        return false;   // Base is gone, server resends from our last ack
+    }
+    if (rle_xor_decode(msg + STREAM_HEADER_SIZE, len, next, sizeof(next)) < 0)
+        return false;
+
+    memcpy(c->frames[frame % STREAM_HISTORY], next, sizeof(next));
+    c->numbers[frame % STREAM_HISTORY] = frame;
+    c->current = frame;
+    c->decoded++;
+
+    uint8_t ack[4];
+    for (int i = 0; i < 4; i++) ack[i] = frame >> (8 * i);
+    return send(c->fd, ack, sizeof(ack), 0) == sizeof(ack);
+}
+
+// Read available bytes and handle complete messages, false on disconnect
+static bool pump(Client* c, bool* got_frame) {
+
+    ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+    if (n <= 0) return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    c->len += n;
+    c->bytes += n;
+
+    while (c->len >= STREAM_HEADER_SIZE) {
+        int size = STREAM_HEADER_SIZE + get_le(c->buf + 9, 2);
+        if (size > (int)sizeof(c->buf)) return false;
+        if (c->len < size) break;
+        if (handle_message(c, c->buf)) *got_frame = true;
+        memmove(c->buf, c->buf + size, c->len - size);
+        c->len -= size;
+    }
+    return true;
+}
+
+// Draw newest frame to terminal
+static void draw(const Client* c) {
+    const uint8_t* f = c->frames[c->current % STREAM_HISTORY];
+    printf("\033[H");
+    for (int y = 0; y < SCREEN_HEIGHT; y += 2) {
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            int i = y * SCREEN_WIDTH + x;
+            int j = i + SCREEN_WIDTH;
+            int top = (f[i / 8] >> (7 - i % 8)) & 1;
+            int bot = (f[j / 8] >> (7 - j % 8)) & 1;
+            printf("%s", top ? (bot ? "█" : "▀") : (bot ? "▄" : " "));
+        }
+        printf("\n");
+    }
+    printf("frame %ld, %ld keyframes, %ld bytes\n",
+           c->current, c->keyframes, c->bytes);
+    fflush(stdout);
+}
+
+// Open a viewer connection
+static bool open_client(Client* c, const char* addr) {
+    memset(c, 0, sizeof(*c));
+    for (int i = 0; i < STREAM_HISTORY; i++) c->numbers[i] = -1;
+    c->current = -1;
+    c->fd = connect_socket(addr);
+    return c->fd >= 0;
+}
+
+// Watch stream in terminal
+static int watch(const char* addr) {
+    static Client c;
+    if (!open_client(&c, addr)) {
+        printf("Unable to connect to %s\n", addr);
+        return 1;
+    }
+    printf("\033[2J");
+    bool got = false;
+    while (pump(&c, &got)) {
+        if (got) draw(&c);
+        got = false;
+    }
+    return 0;
+}
+
+// Connect many viewers and report bandwidth per viewer
+static int bench(int n, const char* addr, double duration) {
+
+    Client* clients = calloc(n, sizeof(Client));
+    struct pollfd* fds = calloc(n, sizeof(struct pollfd));
+    for (int i = 0; i < n; i++) {
+        if (!open_client(&clients[i], addr)) {
+            printf("Unable to connect viewer %d to %s\n", i, addr);
+            return 1;
+        }
+        set_nonblocking(clients[i].fd);
+        fds[i].fd = clients[i].fd;
+        fds[i].events = POLLIN;
+    }
+
+    double start = now();
+    int alive = n;
+    while (alive > 0 && now() - start < duration) {
+        if (poll(fds, n, 100) <= 0) continue;
+        for (int i = 0; i < n; i++) {
+            if (fds[i].fd < 0 || !(fds[i].revents & (POLLIN | POLLHUP)))
+                continue;
+            bool got = false;
+            if (!pump(&clients[i], &got)) {
+                close(fds[i].fd);
+                fds[i].fd = -1;
+                alive--;
+            }
+        }
+    }
+    double elapsed = now() - start;
+
+    long bytes = 0, decoded = 0, keyframes = 0;
+    for (int i = 0; i < n; i++) {
+        bytes += clients[i].bytes;
+        decoded += clients[i].decoded;
+        keyframes += clients[i].keyframes;
+        if (fds[i].fd >= 0) close(fds[i].fd);
+    }
+    printf("viewers: %d, %.1fs, %ld frames decoded, %ld keyframes\n",
+           n, elapsed, decoded, keyframes);
+    printf("bandwidth: %.3f kB/s per viewer, %.1f frames/s per viewer, "
+           "%.1f bytes per frame\n", bytes / elapsed / 1e3 / n,
+           decoded / elapsed / n, decoded ? (double)bytes / decoded : 0.0);
+
+    free(clients);
+    free(fds);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+
+    if (argc == 2) return watch(argv[1]);
+    if (argc >= 4 && strcmp(argv[1], "--bench") == 0)
+        return bench(atoi(argv[2]), argv[3], argc > 4 ? atof(argv[4]) : 10);
+
+    printf("Usage: chip8-viewer <port>|unix:<path>\n"
+           "       chip8-viewer --bench <viewers> <port>|unix:<path> [seconds]\n");
+    return 1;
+}